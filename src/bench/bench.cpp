@@ -0,0 +1,555 @@
+// Microbenchmarks for the hot paths, on synthetic inputs generated from fixed
+// seeds. Results go to stdout as JSON:
+//
+//   ./bench_app [name filter] [--min-time seconds]
+//
+// Every benchmark reports ns/op, throughput (items/s for its own unit of
+// work), heap allocations and bytes per op, and latency percentiles.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <new>
+
+#include "../catalog/catalog.h"
+#include "../triangle/triangle.h"
+#include "../triad/triad.h"
+#include "../fits/fits_io.h"
+#include "../solver/solver.h"
+#include "../pipeline/camera_pool.h"
+#include "../synth/synth.h"
+#include "../tracking/tracking.h"
+#include "fitsio.h" // CFITSIO, for writing the synthetic frames
+
+// --- Allocation counting ---
+// Every heap allocation in the process goes through these, so the numbers
+// include allocations made inside the library.
+
+static std::atomic<size_t> allocation_count(0);
+static std::atomic<size_t> allocation_bytes(0);
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// --- Harness ---
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchResult {
+    std::string name;
+    size_t iterations = 0;  // ops timed
+    double ns_per_op = 0.0;
+    double items_per_op = 0.0;
+    std::string item_unit;
+    double items_per_second = 0.0;
+    double allocations_per_op = 0.0;
+    double bytes_per_op = 0.0;
+    double p50_ns = 0.0, p90_ns = 0.0, p99_ns = 0.0, max_ns = 0.0;
+};
+
+struct BenchConfig {
+    std::string filter;
+    double min_seconds = 0.5;
+};
+
+// Times op() individually (or in batches of `batch` for very short ops, in
+// which case the percentiles are over batch averages) until min_seconds have
+// passed and at least min_iterations ops ran. op returns the number of items
+// it processed, for the throughput figure.
+static void run_bench(const BenchConfig& config, std::vector<BenchResult>& results, const std::string& name,
+                      const std::string& item_unit, size_t batch, const std::function<double()>& op) {
+    if (!config.filter.empty() && name.find(config.filter) == std::string::npos) return;
+    const size_t min_iterations = 10;
+
+    // warm-up: caches, lazily built tables, first-touch page faults, and
+    // buffers that are only resized on the call after they overflowed
+    const size_t warmup = std::max<size_t>(batch, 2);
+    double items = 0.0;
+    for (size_t i = 0; i < warmup; ++i) {
+        items += op();
+    }
+    items /= warmup;
+
+    // allocations are counted around the op only, not the sample bookkeeping
+    std::vector<double> samples;
+    size_t allocs = 0, bytes = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point now = start;
+    while (samples.size() * batch < min_iterations ||
+           std::chrono::duration<double>(now - start).count() < config.min_seconds) {
+        size_t allocs_before = allocation_count.load(std::memory_order_relaxed);
+        size_t bytes_before = allocation_bytes.load(std::memory_order_relaxed);
+        Clock::time_point t0 = Clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            op();
+        }
+        now = Clock::now();
+        allocs += allocation_count.load(std::memory_order_relaxed) - allocs_before;
+        bytes += allocation_bytes.load(std::memory_order_relaxed) - bytes_before;
+        samples.push_back(std::chrono::duration<double, std::nano>(now - t0).count() / batch);
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.iterations = samples.size() * batch;
+    double total_ns = 0.0;
+    for (double s : samples) total_ns += s * batch;
+    r.ns_per_op = total_ns / r.iterations;
+    r.items_per_op = items;
+    r.item_unit = item_unit;
+    r.items_per_second = r.ns_per_op > 0 ? items * 1e9 / r.ns_per_op : 0.0;
+    r.allocations_per_op = static_cast<double>(allocs) / r.iterations;
+    r.bytes_per_op = static_cast<double>(bytes) / r.iterations;
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) {
+        size_t k = std::min(samples.size() - 1, static_cast<size_t>(p * (samples.size() - 1) + 0.5));
+        return samples[k];
+    };
+    r.p50_ns = percentile(0.50);
+    r.p90_ns = percentile(0.90);
+    r.p99_ns = percentile(0.99);
+    r.max_ns = samples.back();
+
+    std::cerr << name << ": " << r.ns_per_op << " ns/op" << std::endl;
+    results.push_back(r);
+}
+
+static void print_json(const std::vector<BenchResult>& results) {
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n  \"context\": {\"hardware_threads\": " << std::thread::hardware_concurrency() << "},\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\""
+            << ", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.ns_per_op
+            << ", \"items_per_op\": " << r.items_per_op
+            << ", \"item_unit\": \"" << r.item_unit << "\""
+            << ", \"items_per_second\": " << r.items_per_second
+            << ", \"allocations_per_op\": " << r.allocations_per_op
+            << ", \"bytes_per_op\": " << r.bytes_per_op
+            << ", \"p50_ns\": " << r.p50_ns
+            << ", \"p90_ns\": " << r.p90_ns
+            << ", \"p99_ns\": " << r.p99_ns
+            << ", \"max_ns\": " << r.max_ns << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    std::cout << out.str();
+}
+
+// --- Synthetic inputs ---
+
+static Star random_unit(std::mt19937& rng) {
+    std::normal_distribution<double> n(0.0, 1.0);
+    Star s = {0, n(rng), n(rng), n(rng), 0.0};
+    double mag = std::sqrt(s.x * s.x + s.y * s.y + s.z * s.z);
+    s.x /= mag; s.y /= mag; s.z /= mag;
+    return s;
+}
+
+static Star perturb(const Star& s, double sigma, std::mt19937& rng) {
+    std::normal_distribution<double> n(0.0, sigma);
+    Star p = {s.id, s.x + n(rng), s.y + n(rng), s.z + n(rng), s.magnitude};
+    double mag = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+    p.x /= mag; p.y /= mag; p.z /= mag;
+    return p;
+}
+
+// Hipparcos-layout CSV with uniformly distributed stars and a roughly
+// realistic magnitude distribution (counts grow ~x3 per magnitude, about
+// 4% of the rows pass the default V < 6 cut)
+static void write_catalog_csv(const std::string& filename, int rows, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::ofstream out(filename);
+    out << "Catalog,HIP,Proxy,RAhms,DEdms,Vmag,VarFlag,r_Vmag,RAdeg,DEdeg,AstroRef\n";
+    out.precision(10);
+    for (int i = 1; i <= rows; ++i) {
+        double ra = 360.0 * u(rng);
+        double dec = std::asin(2.0 * u(rng) - 1.0) * 180.0 / M_PI;
+        double vmag = 8.9 + std::log(std::max(u(rng), 1e-12)) / std::log(3.0);
+        out << "H," << i << ",,,," << vmag << ",,," << ra << "," << dec << ",\n";
+    }
+}
+
+// 16-bit frame with Gaussian stars on a noisy background
+static void write_frame(const std::string& filename, long width, long height, int stars, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 5.0);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+
+    std::vector<double> image(width * height);
+    for (double& v : image) v = 100.0 + noise(rng);
+    for (int s = 0; s < stars; ++s) {
+        double cx = u(rng) * width, cy = u(rng) * height;
+        double amplitude = 200.0 + 3000.0 * u(rng), sigma = 0.8 + 1.5 * u(rng);
+        for (long y = std::max(0L, (long)cy - 8); y < std::min(height, (long)cy + 9); ++y) {
+            for (long x = std::max(0L, (long)cx - 8); x < std::min(width, (long)cx + 9); ++x) {
+                double r2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                image[y * width + x] += amplitude * std::exp(-r2 / (2.0 * sigma * sigma));
+            }
+        }
+    }
+    std::vector<uint16_t> pixels(image.size());
+    for (size_t i = 0; i < image.size(); ++i) {
+        pixels[i] = static_cast<uint16_t>(std::clamp(image[i], 0.0, 65535.0));
+    }
+
+    fitsfile* fptr;
+    int status = 0;
+    long naxes[2] = {width, height};
+    long fpixel[2] = {1, 1};
+    fits_create_file(&fptr, ("!" + filename).c_str(), &status);
+    fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+    fits_write_pix(fptr, TUSHORT, fpixel, width * height, pixels.data(), &status);
+    fits_close_file(fptr, &status);
+    if (status) {
+        fits_report_error(stderr, status);
+    }
+}
+
+// Body-frame view of the catalog for a random attitude, with centroid noise
+static std::vector<Star> synthetic_view(const std::vector<Star>& catalog, const Quaternion& q, double half_fov,
+                                        double noise, std::mt19937& rng) {
+    std::vector<Star> body;
+    for (const Star& s : catalog) {
+        Star b = rotate_to_body(q, s);
+        if (b.z > 0 && std::abs(b.x / b.z) < std::tan(half_fov) && std::abs(b.y / b.z) < std::tan(half_fov)) {
+            body.push_back(perturb(b, noise, rng));
+        }
+    }
+    return body;
+}
+
+// --- Benchmarks ---
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--min-time" && i + 1 < argc) {
+            config.min_seconds = std::atof(argv[++i]);
+        } else {
+            config.filter = arg;
+        }
+    }
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "startracker_bench";
+    std::filesystem::create_directories(dir);
+    std::vector<BenchResult> results;
+
+    // catalog parsing
+    const std::string csv = (dir / "catalog.csv").string();
+    const int csv_rows = 120000;
+    write_catalog_csv(csv, csv_rows, 1);
+    run_bench(config, results, "csv_to_catalog/120k_rows", "rows", 1, [&]() {
+        return csv_to_catalog(csv).empty() ? 0.0 : csv_rows;
+    });
+
+    std::vector<Star> catalog = csv_to_catalog(csv);
+
+    // triangle generation
+    std::vector<Triangle> triangles;
+    run_bench(config, results, "catalog_to_triangles/" + std::to_string(catalog.size()) + "_stars", "triangles", 1, [&]() {
+        triangles = catalog_to_triangles(catalog);
+        return static_cast<double>(triangles.size());
+    });
+    if (triangles.empty()) {
+        triangles = catalog_to_triangles(catalog);
+    }
+
+    // triangle lookups: exact hits, noisy hits and misses
+    {
+        std::mt19937 rng(2);
+        std::vector<long> id_to_pos;
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            if (catalog[i].id >= (long)id_to_pos.size()) id_to_pos.resize(catalog[i].id + 1, -1);
+            id_to_pos[catalog[i].id] = i;
+        }
+
+        const size_t num_queries = 1024;
+        std::vector<StarTriple> hits, noisy, misses;
+        std::uniform_int_distribution<size_t> pick(0, triangles.size() - 1);
+        for (size_t q = 0; q < num_queries; ++q) {
+            const Triangle& t = triangles[pick(rng)];
+            StarTriple exact = {catalog[id_to_pos[t.star1]], catalog[id_to_pos[t.star2]], catalog[id_to_pos[t.star3]]};
+            hits.push_back(exact);
+            noisy.push_back({perturb(exact.s1, 2e-4, rng), perturb(exact.s2, 2e-4, rng), perturb(exact.s3, 2e-4, rng)});
+
+            // two real stars and one far outside the field
+            Star far = random_unit(rng);
+            misses.push_back({exact.s1, exact.s2, far});
+        }
+
+        TriangleIndex index = build_triangle_index(triangles);
+        TriangleTable table = triangles_to_table(triangles, catalog);
+
+        size_t next = 0;
+        auto lookup = [&](const std::vector<StarTriple>& queries, auto find) {
+            return [&queries, &next, find]() {
+                const StarTriple& q = queries[next++ % queries.size()];
+                return find(q).star1 != -1 ? 1.0 : 0.0;
+            };
+        };
+        auto linear = [&](const StarTriple& q) { return find_triangle(q.s1, q.s2, q.s3, triangles); };
+        auto indexed = [&](const StarTriple& q) { return find_triangle(q.s1, q.s2, q.s3, triangles, index); };
+        auto compact = [&](const StarTriple& q) { return find_triangle(q.s1, q.s2, q.s3, table, catalog); };
+
+        run_bench(config, results, "find_triangle/linear/hit", "matches", 1, lookup(hits, linear));
+        run_bench(config, results, "find_triangle/linear/noisy", "matches", 1, lookup(noisy, linear));
+        run_bench(config, results, "find_triangle/linear/miss", "matches", 1, lookup(misses, linear));
+        run_bench(config, results, "find_triangle/index/hit", "matches", 1, lookup(hits, indexed));
+        run_bench(config, results, "find_triangle/index/noisy", "matches", 1, lookup(noisy, indexed));
+        run_bench(config, results, "find_triangle/index/miss", "matches", 1, lookup(misses, indexed));
+        run_bench(config, results, "find_triangle/table/noisy", "matches", 1, lookup(noisy, compact));
+
+        std::vector<Triangle> matches(noisy.size());
+        run_bench(config, results, "find_triangles/table/noisy_batch_1024", "queries", 1, [&]() {
+            find_triangles(noisy.data(), noisy.size(), table, catalog, matches.data());
+            return static_cast<double>(noisy.size());
+        });
+    }
+
+    // star detection at several frame sizes and star densities
+    {
+        const long sizes[] = {512, 1024, 2048};
+        const int densities[] = {50, 500};
+        for (long size : sizes) {
+            for (int stars : densities) {
+                std::string name = std::to_string(size) + "x" + std::to_string(size) + "_" + std::to_string(stars) + "_stars";
+                std::string frame = (dir / ("frame_" + name + ".fits")).string();
+                write_frame(frame, size, size, stars, 3);
+
+                run_bench(config, results, "fits_to_data/" + name, "pixels", 1, [&]() {
+                    fits_to_data(frame);
+                    return static_cast<double>(size * size);
+                });
+                run_bench(config, results, "fits_to_data_streaming/" + name, "pixels", 1, [&]() {
+                    fits_to_data_streaming(frame);
+                    return static_cast<double>(size * size);
+                });
+
+                // detection alone, on a frame already in memory
+                FrameBuffer buffer;
+                fits_read_frame(frame, 0, buffer);
+                DetectionOptions options;
+                run_bench(config, results, "detect_frame/" + name, "pixels", 1, [&]() {
+                    detect_frame(buffer, options);
+                    return static_cast<double>(size * size);
+                });
+                DetectionWorkspace workspace;
+                ImageData data = {};
+                run_bench(config, results, "detect_frame_workspace/" + name, "pixels", 1, [&]() {
+                    detect_frame(buffer, options, workspace, data);
+                    return static_cast<double>(size * size);
+                });
+
+                // whole file already in memory, as received from a camera link
+                std::ifstream file(frame, std::ios::binary);
+                std::vector<char> blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                run_bench(config, results, "fits_to_data_memory/" + name, "pixels", 1, [&]() {
+                    fits_to_data_memory(blob.data(), blob.size(), options, workspace, data);
+                    return static_cast<double>(size * size);
+                });
+            }
+        }
+    }
+
+    // attitude estimation
+    {
+        std::mt19937 rng(4);
+        Quaternion q = random_attitude(rng);
+        const int counts[] = {2, 3, 20, 50};
+        for (int n : counts) {
+            std::vector<Observation> obs;
+            std::uniform_real_distribution<double> u(-0.08, 0.08);
+            for (int i = 0; i < n; ++i) {
+                Star b = {i, u(rng), u(rng), 1.0, 0.0};
+                double mag = std::sqrt(b.x * b.x + b.y * b.y + 1.0);
+                b.x /= mag; b.y /= mag; b.z /= mag;
+                obs.push_back({perturb(b, 1e-5, rng), rotate_to_inertial(q, b), 1.0});
+            }
+
+            std::string suffix = "/" + std::to_string(n) + "_stars";
+            volatile double sink = 0.0;
+            if (n == 2) {
+                run_bench(config, results, "compute_attitude" + suffix, "solutions", 64, [&]() {
+                    sink = sink + compute_attitude(obs).w;
+                    return 1.0;
+                });
+            }
+            run_bench(config, results, "compute_attitude_quest" + suffix, "solutions", 64, [&]() {
+                sink = sink + compute_attitude_quest(obs.data(), obs.size()).w;
+                return 1.0;
+            });
+        }
+    }
+
+    // lost-in-space identification on a bright-star catalog
+    {
+        std::vector<Star> bright;
+        for (const Star& s : catalog) {
+            if (s.magnitude < 5.5) bright.push_back(s);
+        }
+        std::vector<Triangle> bright_triangles = catalog_to_triangles(bright);
+        SolverDatabase db = prepare_solver(bright, bright_triangles);
+
+        std::mt19937 rng(5);
+        std::vector<std::vector<Star>> views;
+        std::vector<Quaternion> attitudes;
+        while (views.size() < 64) {
+            Quaternion q = random_attitude(rng);
+            std::vector<Star> view = synthetic_view(bright, q, 5.0 * M_PI / 180.0, 1e-4, rng);
+            if (view.size() >= 6) {
+                views.push_back(view);
+                attitudes.push_back(q);
+            }
+        }
+
+        size_t next = 0;
+        run_bench(config, results, "solve_stars/lost_in_space", "solutions", 1, [&]() {
+            return solve_stars(views[next++ % views.size()], db).solved ? 1.0 : 0.0;
+        });
+
+        // the same views identified from a prior that is 0.1 degree off
+        std::vector<Quaternion> priors;
+        for (const Quaternion& q : attitudes) {
+            Star axis = random_unit(rng);
+            const double error = 0.1 * M_PI / 180.0;
+            const double rate[3] = {axis.x * error, axis.y * error, axis.z * error};
+            priors.push_back(propagate_attitude(q, rate, 1.0));
+        }
+        TrackingOptions tracking;
+        TrackingState state;
+        SolveResult tracked;
+        next = 0;
+        run_bench(config, results, "track_stars/0.1_deg_prior", "solutions", 1, [&]() {
+            size_t k = next++ % views.size();
+            return track_stars(views[k], priors[k], db, tracking, state, tracked) ? 1.0 : 0.0;
+        });
+
+        // the same views through the 4-star pattern hash, then both engines
+        // on the denser V < 6 catalog
+        SolverOptions pattern_options;
+        pattern_options.engine = ENGINE_PATTERNS;
+        build_solver_patterns(db);
+        next = 0;
+        run_bench(config, results, "solve_stars/patterns", "solutions", 1, [&]() {
+            return solve_stars(views[next++ % views.size()], db, pattern_options).solved ? 1.0 : 0.0;
+        });
+
+        SolverDatabase full_db = prepare_solver(catalog, triangles);
+        const std::string full = std::to_string(catalog.size()) + "_stars";
+        run_bench(config, results, "build_pattern_table/" + full, "patterns", 1, [&]() {
+            build_solver_patterns(full_db);
+            return static_cast<double>(full_db.patterns.count);
+        });
+        if (full_db.patterns.count == 0) {
+            build_solver_patterns(full_db);
+        }
+
+        std::vector<std::vector<Star>> full_views;
+        while (full_views.size() < 64) {
+            std::vector<Star> view = synthetic_view(catalog, random_attitude(rng), 5.0 * M_PI / 180.0, 1e-4, rng);
+            if (view.size() >= 6) full_views.push_back(view);
+        }
+        next = 0;
+        run_bench(config, results, "solve_stars/lost_in_space/" + full, "solutions", 1, [&]() {
+            return solve_stars(full_views[next++ % full_views.size()], full_db).solved ? 1.0 : 0.0;
+        });
+        next = 0;
+        run_bench(config, results, "solve_stars/patterns/" + full, "solutions", 1, [&]() {
+            return solve_stars(full_views[next++ % full_views.size()], full_db, pattern_options).solved ? 1.0 : 0.0;
+        });
+    }
+
+    // four camera heads on one shared context, by worker count
+    {
+        std::vector<Star> bright;
+        for (const Star& s : catalog) {
+            if (s.magnitude < 5.5) bright.push_back(s);
+        }
+        std::vector<Triangle> bright_triangles = catalog_to_triangles(bright);
+        std::shared_ptr<const SolverContext> context = make_solver_context(bright, bright_triangles);
+
+        CameraModel camera;
+        camera.width = camera.height = 1024;
+        camera.focal_length = 50.0;
+        camera.pixel_pitch = 0.01;
+        camera.cx = camera.cy = 511.5;
+
+        std::mt19937 rng(6);
+        std::vector<FrameBuffer> frames;
+        for (int f = 0; f < 16; ++f) {
+            RenderOptions render;
+            render.seed = rng();
+            frames.push_back(render_frame(context->db.stars, context->db.sky, random_attitude(rng), camera, render).frame);
+        }
+
+        const int heads = 4;
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<int> thread_counts = {1, 2, 4};
+        if (hardware > 4) thread_counts.push_back(hardware);
+        for (int threads : thread_counts) {
+            CameraPoolOptions options;
+            options.threads = threads;
+            CameraPool pool(context, std::vector<CameraModel>(heads, camera), options, [](const CameraResult&) {});
+            run_bench(config, results, "camera_pool/4_heads_" + std::to_string(threads) + "_threads", "frames", 1, [&]() {
+                for (size_t f = 0; f < frames.size(); ++f) {
+                    FrameBuffer frame = frames[f];
+                    pool.submit(f % heads, frame);
+                }
+                pool.drain();
+                return static_cast<double>(frames.size());
+            });
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    print_json(results);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+#include "camera.h"
+#include "../instrument/instrument.h"
+
+// Normalized distorted coordinates -> normalized undistorted, by fixed-point iteration
+static void undistort(const CameraModel& camera, double xd, double yd, double& xu, double& yu) {
+    xu = xd;
+    yu = yd;
+    for (int it = 0; it < 20; ++it) {
+        double r2 = xu*xu + yu*yu;
+        double radial = 1.0 + r2 * (camera.k1 + r2 * (camera.k2 + r2 * camera.k3));
+        double dx = 2.0*camera.p1*xu*yu + camera.p2*(r2 + 2.0*xu*xu);
+        double dy = camera.p1*(r2 + 2.0*yu*yu) + 2.0*camera.p2*xu*yu;
+        double next_x = (xd - dx) / radial;
+        double next_y = (yd - dy) / radial;
+        bool done = std::abs(next_x - xu) < 1e-12 && std::abs(next_y - yu) < 1e-12;
+        xu = next_x;
+        yu = next_y;
+        if (done) break;
+    }
+}
+
+Star pixel_to_vector_exact(const CameraModel& camera, double x, double y) {
+    double scale = camera.pixel_pitch / camera.focal_length;
+    double xu, yu;
+    undistort(camera, (x - camera.cx) * scale, (y - camera.cy) * scale, xu, yu);
+
+    double mag = std::sqrt(xu*xu + yu*yu + 1.0);
+    return {0, xu / mag, yu / mag, 1.0 / mag, 0.0};
+}
+
+bool vector_to_pixel(const CameraModel& camera, const Star& v, double& x, double& y) {
+    if (v.z <= 0.0) return false;
+
+    double xu = v.x / v.z, yu = v.y / v.z;
+    double r2 = xu*xu + yu*yu;
+    double radial = 1.0 + r2 * (camera.k1 + r2 * (camera.k2 + r2 * camera.k3));
+    double xd = xu * radial + 2.0*camera.p1*xu*yu + camera.p2*(r2 + 2.0*xu*xu);
+    double yd = yu * radial + camera.p1*(r2 + 2.0*yu*yu) + 2.0*camera.p2*xu*yu;
+
+    double scale = camera.focal_length / camera.pixel_pitch;
+    x = camera.cx + xd * scale;
+    y = camera.cy + yd * scale;
+    return true;
+}
+
+void build_camera_lut(CameraModel& camera, int step) {
+    camera.lut_step = std::max(1, step);
+    // one sample past the last pixel on each axis, so every pixel has four neighbours
+    camera.lut_cols = (camera.width - 1) / camera.lut_step + 2;
+    camera.lut_rows = (camera.height - 1) / camera.lut_step + 2;
+    camera.lut.resize(camera.lut_cols * camera.lut_rows * 3);
+
+    for (long r = 0; r < camera.lut_rows; ++r) {
+        for (long c = 0; c < camera.lut_cols; ++c) {
+            Star v = pixel_to_vector_exact(camera, c * camera.lut_step, r * camera.lut_step);
+            float* out = &camera.lut[(r * camera.lut_cols + c) * 3];
+            out[0] = static_cast<float>(v.x);
+            out[1] = static_cast<float>(v.y);
+            out[2] = static_cast<float>(v.z);
+        }
+    }
+}
+
+Star pixel_to_vector(const CameraModel& camera, double x, double y) {
+    if (camera.lut.empty()) {
+        return pixel_to_vector_exact(camera, x, y);
+    }
+
+    // bilinear interpolation between the four surrounding samples
+    double fx = std::clamp(x / camera.lut_step, 0.0, (double)(camera.lut_cols - 1));
+    double fy = std::clamp(y / camera.lut_step, 0.0, (double)(camera.lut_rows - 1));
+    long c0 = std::min(static_cast<long>(fx), camera.lut_cols - 2);
+    long r0 = std::min(static_cast<long>(fy), camera.lut_rows - 2);
+    double wx = fx - c0;
+    double wy = fy - r0;
+
+    const float* s00 = &camera.lut[(r0 * camera.lut_cols + c0) * 3];
+    const float* s01 = s00 + 3;
+    const float* s10 = s00 + camera.lut_cols * 3;
+    const float* s11 = s10 + 3;
+
+    double v[3];
+    for (int k = 0; k < 3; ++k) {
+        double top = s00[k] + wx * (s01[k] - s00[k]);
+        double bottom = s10[k] + wx * (s11[k] - s10[k]);
+        v[k] = top + wy * (bottom - top);
+    }
+
+    double mag = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    return {0, v[0] / mag, v[1] / mag, v[2] / mag, 0.0};
+}
+
+std::vector<Star> clusters_to_stars(const CameraModel& camera, const std::vector<Cluster>& clusters) {
+    std::vector<Star> stars(clusters.size());
+    clusters_to_stars(camera, clusters.data(), clusters.size(), stars.data());
+    return stars;
+}
+
+void clusters_to_stars(const CameraModel& camera, const Cluster* clusters, size_t count, Star* stars) {
+    INSTRUMENT_SCOPE(STAGE_CONVERT);
+    for (size_t i = 0; i < count; ++i) {
+        const Cluster& cluster = clusters[i];
+        Star s = pixel_to_vector(camera, cluster.x_centroid, cluster.y_centroid);
+        s.id = cluster.id;
+        s.magnitude = (cluster.total_intensity > 0) ? -2.5 * std::log10(cluster.total_intensity) : 99.0;
+        stars[i] = s;
+    }
+}
+
+// --- Calibration files ---
+
+struct CameraHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t width, height;
+    double focal_length, pixel_pitch, cx, cy;
+    double k1, k2, k3, p1, p2;
+    int64_t lut_step, lut_cols, lut_rows;
+};
+
+bool save_camera(const std::string& filename, const CameraModel& camera) {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return false;
+    }
+
+    CameraHeader header = {
+        CAMERA_MAGIC, CAMERA_VERSION,
+        camera.width, camera.height,
+        camera.focal_length, camera.pixel_pitch, camera.cx, camera.cy,
+        camera.k1, camera.k2, camera.k3, camera.p1, camera.p2,
+        camera.lut_step, camera.lut_cols, camera.lut_rows
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(camera.lut.data()), camera.lut.size() * sizeof(float));
+
+    if (!file) {
+        std::cerr << "Error writing file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_camera(const std::string& filename, CameraModel& camera) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return false;
+    }
+
+    CameraHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != CAMERA_MAGIC || header.version != CAMERA_VERSION) {
+        std::cerr << "Error: " << filename << " is not a compatible camera file." << std::endl;
+        return false;
+    }
+
+    // a LUT has to have the layout build_camera_lut gives the image size, or
+    // pixel_to_vector would index outside it; the file has to hold all of it
+    const bool has_lut = header.lut_step != 0 || header.lut_cols != 0 || header.lut_rows != 0;
+    if (has_lut && (header.width < 1 || header.height < 1 || header.lut_step < 1 || header.lut_step > INT_MAX ||
+                    header.lut_cols != (header.width - 1) / header.lut_step + 2 ||
+                    header.lut_rows != (header.height - 1) / header.lut_step + 2)) {
+        std::cerr << "Error: " << filename << " has a pixel LUT that does not match its image size." << std::endl;
+        return false;
+    }
+    const std::streampos data_start = file.tellg();
+    file.seekg(0, std::ios::end);
+    const std::streamoff data_bytes = file.tellg() - data_start;
+    file.seekg(data_start);
+    const std::streamoff sample_bytes = 3 * sizeof(float);
+    const bool complete = has_lut ? data_bytes % sample_bytes == 0 && data_bytes / sample_bytes % header.lut_rows == 0 &&
+                                        data_bytes / sample_bytes / header.lut_rows == header.lut_cols
+                                  : data_bytes == 0;
+    if (!complete) {
+        std::cerr << "Error reading file: " << filename << std::endl;
+        return false;
+    }
+
+    CameraModel loaded;
+    loaded.width = header.width;
+    loaded.height = header.height;
+    loaded.focal_length = header.focal_length;
+    loaded.pixel_pitch = header.pixel_pitch;
+    loaded.cx = header.cx;
+    loaded.cy = header.cy;
+    loaded.k1 = header.k1;
+    loaded.k2 = header.k2;
+    loaded.k3 = header.k3;
+    loaded.p1 = header.p1;
+    loaded.p2 = header.p2;
+    loaded.lut_step = header.lut_step;
+    loaded.lut_cols = header.lut_cols;
+    loaded.lut_rows = header.lut_rows;
+
+    loaded.lut.resize(loaded.lut_cols * loaded.lut_rows * 3);
+    if (!file.read(reinterpret_cast<char*>(loaded.lut.data()), loaded.lut.size() * sizeof(float))) {
+        std::cerr << "Error reading file: " << filename << std::endl;
+        return false;
+    }
+
+    camera = loaded;
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "../catalog/catalog.h"
+#include "../fits/fits_io.h"
+
+#define CAMERA_MAGIC 0x4d435453u // "STCM" little-endian
+#define CAMERA_VERSION 1
+
+// Pinhole camera with Brown-Conrady distortion. The body frame has the
+// boresight along +z, with +x along increasing pixel columns and +y along
+// increasing pixel rows.
+struct CameraModel {
+    long width = 0;  // sensor size, pixels
+    long height = 0;
+
+    double focal_length = 0.0; // mm
+    double pixel_pitch = 0.0;  // mm per pixel
+    double cx = 0.0;           // principal point, pixels
+    double cy = 0.0;
+
+    // distortion on normalized image coordinates
+    double k1 = 0.0, k2 = 0.0, k3 = 0.0; // radial
+    double p1 = 0.0, p2 = 0.0;           // tangential
+
+    // Pixel -> unit vector table sampled every lut_step pixels (xyz per
+    // sample, row-major). Empty until build_camera_lut is called.
+    int lut_step = 0;
+    long lut_cols = 0;
+    long lut_rows = 0;
+    std::vector<float> lut;
+};
+
+// Precomputes the lookup table; step 1 gives a dense table, larger steps are
+// bilinearly interpolated
+void build_camera_lut(CameraModel& camera, int step = 4);
+
+// Exact undistortion (iterative), no table
+Star pixel_to_vector_exact(const CameraModel& camera, double x, double y);
+
+// Table lookup if one was built, exact otherwise
+Star pixel_to_vector(const CameraModel& camera, double x, double y);
+
+// Projection of a body-frame vector through the distortion model (the
+// inverse of pixel_to_vector_exact); false if v points behind the camera.
+// The pixel may lie outside the sensor.
+bool vector_to_pixel(const CameraModel& camera, const Star& v, double& x, double& y);
+
+// Body-frame vectors for cluster centroids. Star::id is the cluster id and
+// Star::magnitude the instrumental magnitude -2.5 log10(total intensity).
+std::vector<Star> clusters_to_stars(const CameraModel& camera, const std::vector<Cluster>& clusters);
+void clusters_to_stars(const CameraModel& camera, const Cluster* clusters, size_t count, Star* stars);
+
+// Calibration and table in one file, so the table is only built once
+bool save_camera(const std::string& filename, const CameraModel& camera);
+bool load_camera(const std::string& filename, CameraModel& camera);
@@ -1,63 +1,172 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cmath>
+#include <cstring>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "catalog.h"
 
+// Field [begin, end) with surrounding blanks removed
+static void trim(const char*& begin, const char*& end) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+}
+
+static bool parse_double(const char* begin, const char* end, double& value) {
+    trim(begin, end);
+    if (begin < end && *begin == '+') ++begin;
+    return std::from_chars(begin, end, value).ptr != begin;
+}
+
+static bool parse_int(const char* begin, const char* end, int& value) {
+    trim(begin, end);
+    if (begin < end && *begin == '+') ++begin;
+    return std::from_chars(begin, end, value).ptr != begin;
+}
+
+// Parses the lines in [begin, end), which starts at a line boundary
+static void parse_lines(const char* begin, const char* end, const CatalogOptions& options, std::vector<Star>& out) {
+    const int columns[4] = {options.id_column, options.magnitude_column, options.ra_column, options.dec_column};
+    const int last_column = *std::max_element(columns, columns + 4);
+
+    const char* line = begin;
+    while (line < end) {
+        const char* line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (line_end == nullptr) line_end = end;
+
+        // only tokenize up to the last column we need
+        const char* field_begin[4] = {};
+        const char* field_end[4] = {};
+        const char* p = line;
+        int column = 0;
+        while (column <= last_column && p <= line_end) {
+            const char* comma = static_cast<const char*>(memchr(p, ',', line_end - p));
+            const char* cell_end = (comma != nullptr) ? comma : line_end;
+            for (int f = 0; f < 4; ++f) {
+                if (columns[f] == column) {
+                    field_begin[f] = p;
+                    field_end[f] = cell_end;
+                }
+            }
+            if (comma == nullptr) {
+                ++column;
+                break;
+            }
+            p = comma + 1;
+            ++column;
+        }
+
+        const char* next_line = line_end + 1;
+
+        //  safety check
+        if (column <= last_column) {
+            line = next_line;
+            continue;
+        }
+
+        // some stars empty, skip faint stars and bad data
+        double vmag, ra_deg, dec_deg;
+        int id = 0;
+        if (!parse_double(field_begin[1], field_end[1], vmag) || vmag > options.magnitude_limit ||
+            !parse_int(field_begin[0], field_end[0], id) ||
+            !parse_double(field_begin[2], field_end[2], ra_deg) ||
+            !parse_double(field_begin[3], field_end[3], dec_deg)) {
+            line = next_line;
+            continue;
+        }
+
+        double ra_rad = ra_deg * (M_PI / 180.0);
+        double dec_rad = dec_deg * (M_PI / 180.0);
+
+        Star s;
+        s.id = id;
+        s.x = cos(dec_rad) * cos(ra_rad);
+        s.y = cos(dec_rad) * sin(ra_rad);
+        s.z = sin(dec_rad);
+        s.magnitude = vmag;
+
+        out.push_back(s);
+        line = next_line;
+    }
+}
+
 std::vector<Star> csv_to_catalog(const std::string& filename) {
+    return csv_to_catalog(filename, CatalogOptions());
+}
+
+std::vector<Star> csv_to_catalog(const std::string& filename, const CatalogOptions& options) {
     std::vector<Star> catalog;
-    std::ifstream file(filename);
 
-    if (!file.is_open()) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
         std::cerr << "Error opening file: " << filename << std::endl;
         return catalog;
     }
 
-    std::string line;
-    std::getline(file, line);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return catalog;
+    }
 
-    while (std::getline(file, line)) {
-        std::istringstream ss(line);
-        std::string cell;
-        std::vector<std::string> row;
+    const size_t size = st.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error mapping file: " << filename << std::endl;
+        return catalog;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
 
-        while (std::getline(ss, cell, ',')) {
-            row.push_back(cell);
-        }
+    const char* data = static_cast<const char*>(mapping);
+    const char* end = data + size;
 
-        //  safety check
-        if (row.size() < 10) {
-            continue;
-        }
+    // skip the header line
+    const char* body = static_cast<const char*>(memchr(data, '\n', size));
+    body = (body != nullptr) ? body + 1 : end;
 
-        try {
-            // some stars empty
-            if (row[5].empty()) {
-                continue;
-            }
+    // split the body into line-aligned chunks, one per thread
+    int num_threads = options.num_threads;
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t body_size = end - body;
+    num_threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(num_threads, body_size / (1 << 16))));
 
-            // skip faint stars
-            double vmag = std::stod(row[5]);
-            if (vmag > 6.0) {
-                continue; 
-            }
+    std::vector<const char*> chunk_start = {body};
+    for (int t = 1; t < num_threads; ++t) {
+        const char* p = body + body_size * t / num_threads;
+        p = std::max(p, chunk_start.back());
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        chunk_start.push_back((newline != nullptr) ? newline + 1 : end);
+    }
+    chunk_start.push_back(end);
 
-            int id = std::stoi(row[1]);
-            double ra_rad = std::stod(row[8]) * (M_PI / 180.0);
-            double dec_rad = std::stod(row[9]) * (M_PI / 180.0);
+    std::vector<std::vector<Star>> partial(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; ++t) {
+        threads.emplace_back(parse_lines, chunk_start[t], chunk_start[t + 1], std::cref(options), std::ref(partial[t]));
+    }
+    parse_lines(chunk_start[0], chunk_start[1], options, partial[0]);
+    for (std::thread& th : threads) {
+        th.join();
+    }
 
-            Star s;
-            s.id = id;
-            s.x = cos(dec_rad) * cos(ra_rad);
-            s.y = cos(dec_rad) * sin(ra_rad);
-            s.z = sin(dec_rad);
-            s.magnitude = vmag;
+    munmap(mapping, size);
 
-            catalog.push_back(s);
-        } catch(...) {
-            continue; // skip bad data
-        }
+    size_t total = 0;
+    for (const auto& p : partial) {
+        total += p.size();
+    }
+    catalog.reserve(total);
+    for (const auto& p : partial) {
+        catalog.insert(catalog.end(), p.begin(), p.end());
     }
 
     return catalog;
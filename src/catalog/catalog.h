@@ -11,4 +11,16 @@ struct Star {
     double magnitude;
 };
 
-std::vector<Star> csv_to_catalog(const std::string& filename);
\ No newline at end of file
+// Column positions are zero-based; the defaults match the Hipparcos CSV export
+struct CatalogOptions {
+    double magnitude_limit = 6.0; // stars fainter than this are skipped
+    int id_column = 1;
+    int magnitude_column = 5;
+    int ra_column = 8;  // degrees
+    int dec_column = 9; // degrees
+    int num_threads = 0; // <= 0 uses every hardware thread
+};
+
+std::vector<Star> csv_to_catalog(const std::string& filename);
+
+std::vector<Star> csv_to_catalog(const std::string& filename, const CatalogOptions& options);
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "database.h"
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + 63) & ~uint64_t(63);
+}
+
+bool write_database(const std::string& filename, const std::vector<Star>& catalog, const std::vector<Triangle>& triangles) {
+    DatabaseHeader header = {};
+    header.magic = DATABASE_MAGIC;
+    header.version = DATABASE_VERSION;
+    header.star_size = sizeof(Star);
+    header.triangle_size = sizeof(Triangle);
+    header.max_fov_rad = MAX_FOV_RAD;
+    header.star_count = catalog.size();
+    header.star_offset = align_up(sizeof(DatabaseHeader));
+    header.triangle_count = triangles.size();
+    header.triangle_offset = align_up(header.star_offset + catalog.size() * sizeof(Star));
+
+    // write to a temporary file and rename, so readers never map a partial file
+    std::string tmp_filename = filename + ".tmp";
+    std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << tmp_filename << std::endl;
+        return false;
+    }
+
+    const char zeros[64] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(zeros, header.star_offset - sizeof(header));
+    file.write(reinterpret_cast<const char*>(catalog.data()), catalog.size() * sizeof(Star));
+    file.write(zeros, header.triangle_offset - (header.star_offset + catalog.size() * sizeof(Star)));
+    file.write(reinterpret_cast<const char*>(triangles.data()), triangles.size() * sizeof(Triangle));
+    file.close();
+
+    if (!file) {
+        std::cerr << "Error writing file: " << tmp_filename << std::endl;
+        std::remove(tmp_filename.c_str());
+        return false;
+    }
+
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Error renaming " << tmp_filename << " to " << filename << std::endl;
+        std::remove(tmp_filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+TriangleDatabase open_database(const std::string& filename) {
+    TriangleDatabase db;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return db;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DatabaseHeader)) {
+        std::cerr << "Error: " << filename << " is not a triangle database." << std::endl;
+        close(fd);
+        return db;
+    }
+
+    size_t size = st.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps its own reference
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error mapping file: " << filename << std::endl;
+        return db;
+    }
+
+    DatabaseHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+
+    bool valid = header.magic == DATABASE_MAGIC &&
+                 header.star_size == sizeof(Star) &&
+                 header.triangle_size == sizeof(Triangle) &&
+                 header.star_offset % 64 == 0 &&
+                 header.triangle_offset % 64 == 0 &&
+                 // written so that no count or offset read from the file can overflow
+                 header.star_offset <= size &&
+                 header.star_count <= (size - header.star_offset) / sizeof(Star) &&
+                 header.triangle_offset <= size &&
+                 header.triangle_count <= (size - header.triangle_offset) / sizeof(Triangle);
+
+    if (!valid) {
+        std::cerr << "Error: " << filename << " is not a compatible triangle database." << std::endl;
+        munmap(mapping, size);
+        return db;
+    }
+
+    if (header.version != DATABASE_VERSION) {
+        std::cerr << "Error: " << filename << " has database version " << header.version
+                  << ", expected " << DATABASE_VERSION << "." << std::endl;
+        munmap(mapping, size);
+        return db;
+    }
+
+    if (header.max_fov_rad != MAX_FOV_RAD) {
+        std::cerr << "Warning: " << filename << " was built for a different MAX_FOV_RAD." << std::endl;
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    db.stars = reinterpret_cast<const Star*>(base + header.star_offset);
+    db.star_count = header.star_count;
+    db.triangles = reinterpret_cast<const Triangle*>(base + header.triangle_offset);
+    db.triangle_count = header.triangle_count;
+    db.mapping = mapping;
+    db.mapping_size = size;
+
+    return db;
+}
+
+void close_database(TriangleDatabase& db) {
+    if (db.mapping != nullptr) {
+        munmap(db.mapping, db.mapping_size);
+    }
+    db = TriangleDatabase();
+}
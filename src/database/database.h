@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "../catalog/catalog.h"
+#include "../triangle/triangle.h"
+
+#define DATABASE_MAGIC 0x42445453u // "STDB" little-endian
+#define DATABASE_VERSION 1
+
+// On-disk layout: header, then the catalog (Star[]), then the triangle table
+// (Triangle[], sorted by side a). Both sections are 64-byte aligned so they
+// can be used in place from the mapping.
+struct DatabaseHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t star_size;     // sizeof(Star) of the builder
+    uint32_t triangle_size; // sizeof(Triangle) of the builder
+    double max_fov_rad;     // MAX_FOV_RAD the table was generated with
+
+    uint64_t star_count;
+    uint64_t star_offset;
+    uint64_t triangle_count;
+    uint64_t triangle_offset;
+};
+
+// Read-only view of a memory-mapped database file.
+// The pointers stay valid until close_database is called.
+struct TriangleDatabase {
+    const Star* stars = nullptr;
+    size_t star_count = 0;
+
+    const Triangle* triangles = nullptr;
+    size_t triangle_count = 0;
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+};
+
+bool write_database(const std::string& filename, const std::vector<Star>& catalog, const std::vector<Triangle>& triangles);
+
+TriangleDatabase open_database(const std::string& filename);
+
+void close_database(TriangleDatabase& db);
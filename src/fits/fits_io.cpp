@@ -1,91 +1,619 @@
 #include <iostream>
-#include <map>
+#include <thread>
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
+#include <cstdio>
+#include <ctime>
 
 #include "fits_io.h"
+#include "../instrument/instrument.h"
 #include "fitsio.h" // CFITSIO
 
-ImageData fits_to_data(const std::string& filename) {
-    ImageData data = {};
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-    fitsfile *fptr;
-    int status = 0;
-    int bitpix = 0;
-    int naxis = 0;
-    long naxes[2] = {1, 1};
-    
-    if (fits_open_file(&fptr, filename.c_str(), READONLY, &status) ) {
-        fits_report_error(stderr, status);
-        return data;
+// mean + THRESHOLD_CONSTANT * stddev, pulled below max when nothing would pass
+static double frame_threshold(double mean, double standard_deviation, double max) {
+    double threshold = mean + THRESHOLD_CONSTANT * standard_deviation;
+    if (threshold >= max) {
+        threshold = mean + 0.8 * (max - mean);
     }
+    return threshold;
+}
 
-    if (fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status)) {
-        fits_report_error(stderr, status);
-        fits_close_file(fptr, &status);
-        return data;
+// global threshold from the frame mean, stddev and max
+static void set_threshold(ImageData& data, double mean, double standard_deviation, double max) {
+    data.intensity_mean = mean;
+    data.intensity_standard_deviation = standard_deviation;
+    
+    // threshold
+    data.intensity_threshold = frame_threshold(mean, standard_deviation, max);
+    if (mean + THRESHOLD_CONSTANT * standard_deviation >= max) {
+        INSTRUMENT_COUNT(COUNTER_THRESHOLD_CLAMPED, 1);
     }
+}
 
-    if (naxis != 2) {
-        fits_report_error(stderr, status);
-        fits_close_file(fptr, &status);
-        return data;
+// Overwrites every field of cluster; the pixel list is emptied but keeps its capacity
+static void fill_cluster(Cluster& cluster, int id, const ClusterMoments& m) {
+    cluster.id = id;
+    cluster.pixels.clear();
+    cluster.x_centroid = 0.0;
+    cluster.y_centroid = 0.0;
+    cluster.total_intensity = 0.0;
+    cluster.xx_moment = 0.0;
+    cluster.yy_moment = 0.0;
+    cluster.xy_moment = 0.0;
+    cluster.pixel_count = m.pixel_count;
+    cluster.x_min = m.x_min;
+    cluster.y_min = m.y_min;
+    cluster.x_max = m.x_max;
+    cluster.y_max = m.y_max;
+    if (m.sum_w > 0) {
+        cluster.x_centroid = m.sum_wx / m.sum_w;
+        cluster.y_centroid = m.sum_wy / m.sum_w;
+        cluster.total_intensity = m.sum_w;
+        cluster.xx_moment = m.sum_wxx / m.sum_w - cluster.x_centroid * cluster.x_centroid;
+        cluster.yy_moment = m.sum_wyy / m.sum_w - cluster.y_centroid * cluster.y_centroid;
+        cluster.xy_moment = m.sum_wxy / m.sum_w - cluster.x_centroid * cluster.y_centroid;
     }
+}
 
-    data.width = naxes[0];
-    data.height = naxes[1];
-    const long num_pixels = data.width * data.height;
-    data.pixels.resize(num_pixels); // pixel array
-    long fpixel[2] = {1, 1};
-    int anynul = 0;
+static Cluster moments_to_cluster(int id, const ClusterMoments& m) {
+    Cluster cluster;
+    fill_cluster(cluster, id, m);
+    return cluster;
+}
 
-    if (fits_read_pix(fptr, TDOUBLE, fpixel, num_pixels, nullptr, data.pixels.data(), &anynul, &status)){
-        fits_report_error(stderr, status);
-        fits_close_file(fptr, &status);
-        return data;
+// --- Native pixel types ---
+
+// CFITSIO datatype code and statistics accumulator for each pixel type.
+// Integer accumulators are exact for 8/16-bit data; wider types sum in double.
+template <typename T> struct PixelTraits;
+template <> struct PixelTraits<uint8_t>  { static constexpr int datatype = TBYTE;   typedef uint64_t Sum; };
+template <> struct PixelTraits<int16_t>  { static constexpr int datatype = TSHORT;  typedef int64_t Sum; };
+template <> struct PixelTraits<uint16_t> { static constexpr int datatype = TUSHORT; typedef uint64_t Sum; };
+template <> struct PixelTraits<int>      { static constexpr int datatype = TINT;    typedef double Sum; };
+template <> struct PixelTraits<float>    { static constexpr int datatype = TFLOAT;  typedef double Sum; };
+template <> struct PixelTraits<double>   { static constexpr int datatype = TDOUBLE; typedef double Sum; };
+
+// Calls f with a value of the pixel type matching the image's equivalent BITPIX
+// (after BZERO/BSCALE), falling back to double for types without a native path
+template <typename F>
+static void with_pixel_type(int equivtype, F&& f) {
+    switch (equivtype) {
+        case BYTE_IMG:   f(uint8_t()); break;
+        case SBYTE_IMG:
+        case SHORT_IMG:  f(int16_t()); break;
+        case USHORT_IMG: f(uint16_t()); break;
+        case LONG_IMG:   f(int()); break;
+        case FLOAT_IMG:  f(float()); break;
+        default:         f(double()); break;
+    }
+}
+
+// Threshold to compare pixels against in their own type. For integer pixels
+// value >= threshold is the same test as value >= ceil(threshold).
+template <typename T>
+static auto native_threshold(double threshold) {
+    if constexpr (std::is_integral<T>::value) {
+        double t = std::ceil(threshold);
+        if (!(t <= std::numeric_limits<T>::max())) return std::numeric_limits<T>::max();
+        if (t < std::numeric_limits<T>::lowest()) return std::numeric_limits<T>::lowest();
+        return static_cast<T>(t);
+    } else {
+        return threshold;
     }
+}
 
-    // mean, stddev, max
-    double sum = 0.0;
-    double sum_sq = 0.0;
+// --- Frame statistics and thresholding ---
+
+// Statistics of one tile: plain count/mean/M2 for combining into frame
+// statistics, and a sigma-clipped background and noise estimate
+struct TileStats {
+    long count = 0;
+    double mean = 0.0;
+    double m2 = 0.0; // sum of squared deviations from mean
     double max = 0.0;
-    for (double val: data.pixels) {
-        sum += val;
-        sum_sq += val * val;
-    
-        if (val > max) {
-            max = val;
+
+    double background = 0.0;
+    double noise = 0.0;
+};
+
+// Smallest noise a background estimate is given, so flat regions do not pass
+// the threshold: half a count for integer pixels, a millionth of the
+// background level (and never zero) for floating-point ones
+template <typename T>
+static double noise_floor(double background) {
+    if (std::is_integral<T>::value) return 0.5;
+    return std::max(1e-6 * std::abs(background), static_cast<double>(std::numeric_limits<float>::min()));
+}
+
+// Chan et al. pairwise combination of count/mean/M2
+static void combine_stats(TileStats& total, const TileStats& tile) {
+    if (tile.count == 0) return;
+    if (total.count == 0) {
+        total.count = tile.count;
+        total.mean = tile.mean;
+        total.m2 = tile.m2;
+        total.max = tile.max;
+        return;
+    }
+    long n = total.count + tile.count;
+    double delta = tile.mean - total.mean;
+    total.mean += delta * tile.count / n;
+    total.m2 += tile.m2 + delta * delta * ((double)total.count * tile.count / n);
+    total.max = std::max(total.max, tile.max);
+    total.count = n;
+}
+
+// --- Tile sweep kernels ---
+// One sweep over a w x h tile sums pixel - shift and its square, takes the
+// max, and (unless mask is null) writes mask = pixel >= threshold, counting
+// the pixels that pass. Sums are exact in int64 for 8/16-bit pixels; wider
+// types sum in double about the tile's first pixel.
+
+template <typename T>
+struct TileSums {
+    typedef typename std::conditional<std::is_integral<typename PixelTraits<T>::Sum>::value, int64_t, double>::type Sum;
+    Sum shift = 0;
+    Sum sum = 0;
+    Sum sum_sq = 0;
+    T max = 0;
+    long hits = 0;
+};
+
+template <typename T, typename Threshold>
+static void sweep_tile_scalar(const T* pixels, long stride, long w, long h, Threshold threshold,
+                              uint8_t* mask, long mask_stride, TileSums<T>& sums) {
+    typedef typename TileSums<T>::Sum Sum;
+    sums = TileSums<T>();
+    if (!std::is_integral<Sum>::value) {
+        sums.shift = pixels[0];
+    }
+    T max = pixels[0];
+    for (long y = 0; y < h; ++y) {
+        const T* row = pixels + y * stride;
+        for (long x = 0; x < w; ++x) {
+            Sum d = static_cast<Sum>(row[x]) - sums.shift;
+            sums.sum += d;
+            sums.sum_sq += d * d;
+            max = std::max(max, row[x]);
+        }
+        if (mask) {
+            uint8_t* row_mask = mask + y * mask_stride;
+            long hits = 0;
+            for (long x = 0; x < w; ++x) {
+                row_mask[x] = (row[x] >= threshold);
+                hits += row_mask[x];
+            }
+            sums.hits += hits;
         }
     }
-    data.intensity_mean = sum / num_pixels;
-    data.intensity_standard_deviation = sqrt((sum_sq / num_pixels) - (data.intensity_mean * data.intensity_mean));
-    
-    // threshold
+    sums.max = max;
+}
+
+typedef void (*TileKernel16)(const uint16_t* pixels, long stride, long w, long h, uint16_t threshold,
+                             uint8_t* mask, long mask_stride, TileSums<uint16_t>& sums);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The 16-bit kernels sum about 32768 so that pixel - shift fits an int16
+// lane: madd gives pair sums (at most 2^16 in magnitude, flushed to int64
+// every row or SWEEP_BLOCK pixels) and pair sums of squares (at most 2^31,
+// zero-extended to uint64 right away).
+
+static const long SWEEP_BLOCK = 1L << 16;
+
+__attribute__((target("avx2")))
+static void sweep_tile_avx2(const uint16_t* pixels, long stride, long w, long h, uint16_t threshold,
+                            uint8_t* mask, long mask_stride, TileSums<uint16_t>& sums) {
+    const __m256i bias = _mm256_set1_epi16(static_cast<short>(0x8000));
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i vt = _mm256_set1_epi16(static_cast<short>(threshold));
+    const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m128i one_byte = _mm_set1_epi8(1);
+
+    sums = TileSums<uint16_t>();
+    sums.shift = 32768;
+    __m256i vmax = _mm256_setzero_si256();
+    __m256i sq = _mm256_setzero_si256();
+    uint16_t max = 0;
+    int64_t sum = 0;
+    uint64_t sum_sq = 0;
+
+    for (long y = 0; y < h; ++y) {
+        const uint16_t* row = pixels + y * stride;
+        uint8_t* row_mask = mask ? mask + y * mask_stride : nullptr;
+        long x = 0;
+        while (x + 16 <= w) {
+            const long end = std::min(w, x + SWEEP_BLOCK);
+            __m256i vsum = _mm256_setzero_si256();
+            for (; x + 16 <= end; x += 16) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+                vmax = _mm256_max_epu16(vmax, v);
+                __m256i d = _mm256_xor_si256(v, bias);
+                vsum = _mm256_add_epi32(vsum, _mm256_madd_epi16(d, ones));
+                __m256i d2 = _mm256_madd_epi16(d, d);
+                sq = _mm256_add_epi64(sq, _mm256_and_si256(d2, low32));
+                sq = _mm256_add_epi64(sq, _mm256_srli_epi64(d2, 32));
+
+                if (row_mask) {
+                    __m256i pass = _mm256_cmpeq_epi16(_mm256_max_epu16(v, vt), v);
+                    __m128i bytes = _mm_packs_epi16(_mm256_castsi256_si128(pass), _mm256_extracti128_si256(pass, 1));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(row_mask + x), _mm_and_si128(bytes, one_byte));
+                    sums.hits += __builtin_popcount(_mm_movemask_epi8(bytes));
+                }
+            }
+            alignas(32) int32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), vsum);
+            for (int k = 0; k < 8; ++k) sum += lanes[k];
+        }
+        for (; x < w; ++x) {
+            int64_t d = static_cast<int64_t>(row[x]) - 32768;
+            sum += d;
+            sum_sq += d * d;
+            max = std::max(max, row[x]);
+            if (row_mask) {
+                row_mask[x] = (row[x] >= threshold);
+                sums.hits += row_mask[x];
+            }
+        }
+    }
+
+    alignas(32) uint64_t sq_lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(sq_lanes), sq);
+    for (int k = 0; k < 4; ++k) sum_sq += sq_lanes[k];
+    alignas(32) uint16_t max_lanes[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(max_lanes), vmax);
+    for (int k = 0; k < 16; ++k) max = std::max(max, max_lanes[k]);
+
+    sums.sum = sum;
+    sums.sum_sq = static_cast<int64_t>(sum_sq);
+    sums.max = max;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void sweep_tile_avx512(const uint16_t* pixels, long stride, long w, long h, uint16_t threshold,
+                              uint8_t* mask, long mask_stride, TileSums<uint16_t>& sums) {
+    const __m512i bias = _mm512_set1_epi16(static_cast<short>(0x8000));
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i vt = _mm512_set1_epi16(static_cast<short>(threshold));
+    const __m512i low32 = _mm512_set1_epi64(0xFFFFFFFF);
+    const __m256i one_byte = _mm256_set1_epi8(1);
+
+    sums = TileSums<uint16_t>();
+    sums.shift = 32768;
+    __m512i vmax = _mm512_setzero_si512();
+    __m512i sq = _mm512_setzero_si512();
+    uint16_t max = 0;
+    int64_t sum = 0;
+    uint64_t sum_sq = 0;
+
+    for (long y = 0; y < h; ++y) {
+        const uint16_t* row = pixels + y * stride;
+        uint8_t* row_mask = mask ? mask + y * mask_stride : nullptr;
+        long x = 0;
+        while (x + 32 <= w) {
+            const long end = std::min(w, x + SWEEP_BLOCK);
+            __m512i vsum = _mm512_setzero_si512();
+            for (; x + 32 <= end; x += 32) {
+                __m512i v = _mm512_loadu_si512(row + x);
+                vmax = _mm512_max_epu16(vmax, v);
+                __m512i d = _mm512_xor_si512(v, bias);
+                vsum = _mm512_add_epi32(vsum, _mm512_madd_epi16(d, ones));
+                __m512i d2 = _mm512_madd_epi16(d, d);
+                sq = _mm512_add_epi64(sq, _mm512_and_si512(d2, low32));
+                sq = _mm512_add_epi64(sq, _mm512_maskz_srli_epi64(0xFF, d2, 32));
+
+                if (row_mask) {
+                    __mmask32 pass = _mm512_cmpge_epu16_mask(v, vt);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(row_mask + x), _mm256_maskz_mov_epi8(pass, one_byte));
+                    sums.hits += __builtin_popcount(pass);
+                }
+            }
+            alignas(64) int32_t lanes[16];
+            _mm512_store_si512(lanes, vsum);
+            for (int k = 0; k < 16; ++k) sum += lanes[k];
+        }
+        for (; x < w; ++x) {
+            int64_t d = static_cast<int64_t>(row[x]) - 32768;
+            sum += d;
+            sum_sq += d * d;
+            max = std::max(max, row[x]);
+            if (row_mask) {
+                row_mask[x] = (row[x] >= threshold);
+                sums.hits += row_mask[x];
+            }
+        }
+    }
+
+    alignas(64) uint64_t sq_lanes[8];
+    _mm512_store_si512(sq_lanes, sq);
+    for (int k = 0; k < 8; ++k) sum_sq += sq_lanes[k];
+    alignas(64) uint16_t max_lanes[32];
+    _mm512_store_si512(max_lanes, vmax);
+    for (int k = 0; k < 32; ++k) max = std::max(max, max_lanes[k]);
+
+    sums.sum = sum;
+    sums.sum_sq = static_cast<int64_t>(sum_sq);
+    sums.max = max;
+}
+
+#endif
+
+static void sweep_tile_u16_scalar(const uint16_t* pixels, long stride, long w, long h, uint16_t threshold,
+                                  uint8_t* mask, long mask_stride, TileSums<uint16_t>& sums) {
+    sweep_tile_scalar(pixels, stride, w, h, threshold, mask, mask_stride, sums);
+}
+
+// Picked once, from what the CPU we are running on supports
+static TileKernel16 select_tile_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) return sweep_tile_avx512;
+    if (__builtin_cpu_supports("avx2")) return sweep_tile_avx2;
+#endif
+    return sweep_tile_u16_scalar;
+}
+
+static const TileKernel16 sweep_tile_u16 = select_tile_kernel();
+
+// Sweeps the w x h tile at (x0, y0); mask points at the whole frame's mask
+// (width elements per row) or is null
+template <typename T, typename Threshold>
+static void sweep_tile(const T* pixels, long stride, long x0, long y0, long w, long h, Threshold threshold,
+                       uint8_t* mask, long width, TileSums<T>& sums) {
+    const T* tile = pixels + y0 * stride + x0;
+    uint8_t* tile_mask = mask ? mask + y0 * width + x0 : nullptr;
+    if constexpr (std::is_same<T, uint16_t>::value) {
+        sweep_tile_u16(tile, stride, w, h, threshold, tile_mask, width, sums);
+    } else {
+        sweep_tile_scalar(tile, stride, w, h, threshold, tile_mask, width, sums);
+    }
+}
+
+// Count, mean, M2 and max of a sweep. Integer sums give the same result
+// whatever the shift, so every kernel agrees exactly.
+template <typename T>
+static TileStats sums_to_stats(const TileSums<T>& sums, long count) {
+    TileStats st;
+    st.count = count;
+    st.max = sums.max;
+    if constexpr (std::is_integral<typename TileSums<T>::Sum>::value) {
+        st.mean = static_cast<double>(sums.sum + count * sums.shift) / count;
+        __int128 n_m2 = static_cast<__int128>(count) * sums.sum_sq - static_cast<__int128>(sums.sum) * sums.sum;
+        st.m2 = static_cast<double>(n_m2) / count;
+    } else {
+        double offset = sums.sum / count;
+        st.mean = sums.shift + offset;
+        st.m2 = std::max(0.0, sums.sum_sq - sums.sum * offset);
+    }
+    st.background = st.mean;
+    st.noise = std::sqrt(st.m2 / count);
+    return st;
+}
+
+// Stats of the w x h tile at (x0, y0): one sweep for count/mean/M2/max, then
+// clip_iterations of sigma clipping over the tile, which is still in cache
+template <typename T>
+static TileStats tile_stats(const T* pixels, long stride, long x0, long y0, long w, long h,
+                            double clip_sigma, int clip_iterations) {
+    TileSums<T> sums;
+    sweep_tile(pixels, stride, x0, y0, w, h, T(), nullptr, 0, sums);
+    TileStats st = sums_to_stats(sums, w * h);
+
+    // sigma-clip stars out of the background estimate
+    double center = st.mean;
+    double sigma = st.noise;
+    long count = st.count;
+    for (int it = 0; it < clip_iterations && sigma > 0; ++it) {
+        const double lo = center - clip_sigma * sigma;
+        const double hi = center + clip_sigma * sigma;
+        double s1 = 0.0, s2 = 0.0;
+        long n = 0;
+        for (long y = y0; y < y0 + h; ++y) {
+            const T* row = pixels + y * stride + x0;
+            for (long x = 0; x < w; ++x) {
+                double v = row[x];
+                bool in = (v >= lo) & (v <= hi);
+                double d = in ? v - center : 0.0;
+                s1 += d;
+                s2 += d * d;
+                n += in;
+            }
+        }
+        if (n == 0) break;
+        double shift = s1 / n;
+        center += shift;
+        sigma = std::sqrt(std::max(0.0, s2 / n - shift * shift));
+        if (n == count) break;
+        count = n;
+    }
+    st.background = center;
+    st.noise = sigma;
+
+    return st;
+}
+
+// Frame statistics and the mean + THRESHOLD_CONSTANT * stddev mask in one
+// sweep. The frame threshold is only known at the end, so each tile row is
+// masked against the threshold of the tiles above it (the first against the
+// largest pixel value). Afterwards the tiles where that could make a
+// difference are masked again: the ones with a pixel at or above the lower
+// of the two thresholds, normally just those holding stars. Rows of pixels
+// are stride elements apart.
+template <typename T>
+static void threshold_global(const T* pixels, long stride, const DetectionOptions& options, ImageData& data, FrameArena& arena) {
+    typedef decltype(native_threshold<T>(0.0)) Threshold;
+    struct SweptTile {
+        Threshold threshold;
+        T max;
+        long hits;
+    };
+
+    const long width = data.width;
+    const long height = data.height;
+    const long tile = std::max(1L, options.tile_size);
+    const long tiles_x = (width + tile - 1) / tile;
+    const long tiles_y = (height + tile - 1) / tile;
+
+    SweptTile* swept = arena.allocate<SweptTile>(tiles_x * tiles_y);
+    uint8_t* mask = data.pixels_mask.data();
+    TileStats total;
+    TileSums<T> sums;
+
+    Threshold provisional = std::numeric_limits<T>::max();
+    for (long ty = 0; ty < tiles_y; ++ty) {
+        long y0 = ty * tile;
+        long h = std::min(tile, height - y0);
+        for (long tx = 0; tx < tiles_x; ++tx) {
+            long x0 = tx * tile;
+            long w = std::min(tile, width - x0);
+            sweep_tile(pixels, stride, x0, y0, w, h, provisional, mask, width, sums);
+            combine_stats(total, sums_to_stats(sums, w * h));
+            swept[ty * tiles_x + tx] = {provisional, sums.max, sums.hits};
+        }
+        provisional = native_threshold<T>(frame_threshold(total.mean, std::sqrt(total.m2 / total.count), total.max));
+    }
+    set_threshold(data, total.mean, std::sqrt(total.m2 / std::max(1L, total.count)), std::max(0.0, total.max));
+
+    const Threshold threshold = native_threshold<T>(data.intensity_threshold);
+    for (long ty = 0; ty < tiles_y; ++ty) {
+        for (long tx = 0; tx < tiles_x; ++tx) {
+            const SweptTile& s = swept[ty * tiles_x + tx];
+            if (s.threshold == threshold || (s.hits == 0 && s.max < threshold)) continue;
+            long x0 = tx * tile;
+            long y0 = ty * tile;
+            sweep_tile(pixels, stride, x0, y0, std::min(tile, width - x0), std::min(tile, height - y0), threshold, mask, width, sums);
+        }
+    }
+}
+
+// Position of pixel coordinate p between tile centers: lower tile and weight
+static void tile_coord(long p, long tile, long num_tiles, long& t0, long& t1, double& w) {
+    double f = std::clamp((p + 0.5) / tile - 0.5, 0.0, (double)(num_tiles - 1));
+    t0 = static_cast<long>(f);
+    t1 = std::min(t0 + 1, num_tiles - 1);
+    w = f - t0;
+}
+
+// Sigma-clipped stats of the h rows starting at y0, one tile per tile_size
+// columns, written to row_tiles and combined into total
+template <typename T>
+static void local_tile_row(const T* pixels, long stride, long width, long y0, long h, const DetectionOptions& options,
+                           TileStats* row_tiles, TileStats& total) {
+    const long tile = std::max(1L, options.tile_size);
+    for (long x0 = 0, tx = 0; x0 < width; x0 += tile, ++tx) {
+        TileStats& st = row_tiles[tx];
+        st = tile_stats(pixels, stride, x0, y0, std::min(tile, width - x0), h, options.clip_sigma, options.clip_iterations);
+        // flat tiles still need some noise, or every pixel in them would pass
+        st.noise = std::max(st.noise, noise_floor<T>(st.background));
+        combine_stats(total, st);
+    }
+}
+
+// background + THRESHOLD_CONSTANT * noise along row y, bilinearly
+// interpolated between the tile centers around it. col_t0/col_t1/col_w are
+// tile_coord of every column; bg_col and noise_col hold tiles_x values.
+static void local_row_threshold(const TileStats* tiles, long tiles_x, long tiles_y, long tile, long y, long width,
+                                const long* col_t0, const long* col_t1, const double* col_w,
+                                double* bg_col, double* noise_col, double* row_threshold) {
+    long t0, t1;
+    double wy;
+    tile_coord(y, tile, tiles_y, t0, t1, wy);
+    for (long tx = 0; tx < tiles_x; ++tx) {
+        const TileStats& a = tiles[t0 * tiles_x + tx];
+        const TileStats& b = tiles[t1 * tiles_x + tx];
+        bg_col[tx] = a.background + wy * (b.background - a.background);
+        noise_col[tx] = a.noise + wy * (b.noise - a.noise);
+    }
+    for (long x = 0; x < width; ++x) {
+        double bg = bg_col[col_t0[x]] + col_w[x] * (bg_col[col_t1[x]] - bg_col[col_t0[x]]);
+        double noise = noise_col[col_t0[x]] + col_w[x] * (noise_col[col_t1[x]] - noise_col[col_t0[x]]);
+        row_threshold[x] = bg + THRESHOLD_CONSTANT * noise;
+    }
+}
+
+// Frame-wide numbers reported alongside a local threshold, for reference
+static void set_local_statistics(ImageData& data, const TileStats& total) {
+    data.intensity_mean = total.mean;
+    data.intensity_standard_deviation = std::sqrt(total.m2 / std::max(1L, total.count));
     data.intensity_threshold = data.intensity_mean + THRESHOLD_CONSTANT * data.intensity_standard_deviation;
-    if (data.intensity_threshold >= max) {
-        std::cout << "Warning: Computed threshold exceeds max intensity." << std::endl;
-        data.intensity_threshold = data.intensity_mean + 0.8 * (max - data.intensity_mean);
+}
+
+// Threshold against a background and noise map bilinearly interpolated
+// between tile centers. Rows are masked as soon as the tile rows they
+// interpolate from are done, so pixels are thresholded while still in cache.
+template <typename T>
+static void threshold_local(const T* pixels, long stride, const DetectionOptions& options, ImageData& data, FrameArena& arena) {
+    const long width = data.width;
+    const long height = data.height;
+    const long tile = std::max(1L, options.tile_size);
+    const long tiles_x = (width + tile - 1) / tile;
+    const long tiles_y = (height + tile - 1) / tile;
+
+    TileStats* tiles = arena.allocate<TileStats>(tiles_x * tiles_y);
+    TileStats total;
+
+    long* col_t0 = arena.allocate<long>(width);
+    long* col_t1 = arena.allocate<long>(width);
+    double* col_w = arena.allocate<double>(width);
+    for (long x = 0; x < width; ++x) {
+        tile_coord(x, tile, tiles_x, col_t0[x], col_t1[x], col_w[x]);
     }
 
-    // mask
-    data.pixels_mask.resize(num_pixels);
-    for (long i = 0; i < num_pixels; i++) {
-        data.pixels_mask[i] = (data.pixels[i] >= data.intensity_threshold);
+    double* bg_col = arena.allocate<double>(tiles_x);
+    double* noise_col = arena.allocate<double>(tiles_x);
+    double* row_threshold = arena.allocate<double>(width);
+    uint8_t* mask = data.pixels_mask.data();
+    long next_row = 0;
+
+    for (long ty = 0; ty < tiles_y; ++ty) {
+        long y0 = ty * tile;
+        local_tile_row(pixels, stride, width, y0, std::min(tile, height - y0), options, tiles + ty * tiles_x, total);
+
+        // mask every row whose interpolation only needs tile rows up to ty
+        for (; next_row < height; ++next_row) {
+            long t0, t1;
+            double wy;
+            tile_coord(next_row, tile, tiles_y, t0, t1, wy);
+            if (t1 > ty) break;
+
+            local_row_threshold(tiles, tiles_x, tiles_y, tile, next_row, width, col_t0, col_t1, col_w,
+                                bg_col, noise_col, row_threshold);
+            const T* row = pixels + next_row * stride;
+            uint8_t* row_mask = mask + next_row * width;
+            for (long x = 0; x < width; ++x) {
+                row_mask[x] = (row[x] >= row_threshold[x]);
+            }
+        }
     }
 
-    // labeling using Union-Find
-    std::vector<int> labels(num_pixels, 0);
-    UnionFind uf(num_pixels / 2 + 1);
-    int label = 1;
-    for (long y = 0; y < data.height; ++y) {
-        for (long x = 0; x < data.width; ++x) {
-            long idx = y * data.width + x;
-            if (!data.pixels_mask[idx]) {
+    set_local_statistics(data, total);
+}
+
+// --- Connected-component labeling ---
+
+// Raster-scan labeling of rows [row_begin, row_end) against the row above,
+// ignoring anything above row_begin. New labels start at first_label;
+// next_label is set to one past the last label used.
+static void label_strip(const uint8_t* mask, long width, long row_begin, long row_end,
+                        int first_label, int* labels, UnionFind& uf, int& next_label) {
+    int label = first_label;
+    for (long y = row_begin; y < row_end; ++y) {
+        for (long x = 0; x < width; ++x) {
+            long idx = y * width + x;
+            if (!mask[idx]) {
+                labels[idx] = 0;
                 continue;
             }
 
             int left = (x > 0) ? labels[idx - 1] : 0;
-            int top = (y > 0) ? labels[idx - data.width] : 0;
+            int top = (y > row_begin) ? labels[idx - width] : 0;
 
             if (left == 0 && top == 0) {
                 labels[idx] = label;
@@ -96,61 +624,161 @@ ImageData fits_to_data(const std::string& filename) {
                 labels[idx] = top;
             } else {
                 labels[idx] = left;
-                if (left != top) 
-                {
+                if (left != top) {
                     uf.unite(left, top);
                 }
             }
         }
     }
+    next_label = label;
+}
 
-    // resolve and cluster
-    std::map<int, int> label_to_vector;
+// Writes every entry of labels; scratch arrays come from arena
+static int label_components(const uint8_t* mask, long width, long height, int num_threads, int* labels, FrameArena& arena) {
+    const long num_pixels = width * height;
+    if (num_pixels == 0) {
+        return 0;
+    }
 
-    for (long i = 0; i < num_pixels; ++i) {
-        if (labels[i] != 0) {
-            int root = uf.find(labels[i]);
-            labels[i] = root;
+    // a row can start at most (width + 1) / 2 new components, which bounds the
+    // label range of each strip; ranges increase with the strip's first row
+    const long labels_per_row = (width + 1) / 2;
+    const int num_parents = 1 + height * labels_per_row;
+    UnionFind uf(arena.allocate<int>(num_parents), num_parents);
 
-            // create new cluster if it doesn't exist
-            if (label_to_vector.find(root) == label_to_vector.end()) {
-                label_to_vector[root] = data.clusters.size();
-                data.clusters.push_back(Cluster{root, {}});
-            }
+    num_threads = std::max(1, std::min<int>(num_threads, height));
+    const long strip_rows = (height + num_threads - 1) / num_threads;
 
-            int cluster_idx = label_to_vector[root];
+    const long num_strips = (height + strip_rows - 1) / strip_rows;
+    int* strip_next = arena.allocate<int>(num_strips);
+
+    std::vector<std::thread> threads;
+    for (long s = 1; s < num_strips; ++s) {
+        long row = s * strip_rows;
+        long row_end = std::min(height, row + strip_rows);
+        threads.emplace_back(label_strip, mask, width, row, row_end,
+                             1 + row * labels_per_row, labels, std::ref(uf), std::ref(strip_next[s]));
+    }
+    label_strip(mask, width, 0, std::min(height, strip_rows), 1, labels, uf, strip_next[0]);
+    for (std::thread& th : threads) {
+        th.join();
+    }
 
-            long x = i % data.width;
-            long y = i / data.width;
-            data.clusters[cluster_idx].pixels.push_back(Pixel{x, y, data.pixels[i]});
+    // join components across strip borders
+    for (long row = strip_rows; row < height; row += strip_rows) {
+        for (long x = 0; x < width; ++x) {
+            long idx = row * width + x;
+            if (labels[idx] != 0 && labels[idx - width] != 0) {
+                uf.unite(labels[idx], labels[idx - width]);
+            }
         }
     }
 
-    // compute centroids and total intensities
-    for (Cluster& cluster : data.clusters) {
-        double sum_x = 0.0;
-        double sum_y = 0.0;
-        double sum_intensity = 0.0;
+    // Roots are the smallest label of each component, which is the label of its
+    // first pixel in raster order. Number them in label order.
+    int* compact = arena.allocate<int>(num_parents);
+    compact[0] = 0;
+    int count = 0;
+    for (long s = 0; s < num_strips; ++s) {
+        for (int l = 1 + s * strip_rows * labels_per_row; l < strip_next[s]; ++l) {
+            int root = uf.find(l);
+            compact[l] = (root == l) ? ++count : compact[root];
+        }
+    }
 
-        for (const Pixel& pixel : cluster.pixels) {
-            sum_x += pixel.x * pixel.intensity;
-            sum_y += pixel.y * pixel.intensity;
-            sum_intensity += pixel.intensity;
+    // relabel strip by strip
+    auto relabel = [&](long begin, long end) {
+        for (long i = begin; i < end; ++i) {
+            labels[i] = compact[labels[i]];
         }
+    };
+    threads.clear();
+    for (long row = strip_rows; row < height; row += strip_rows) {
+        threads.emplace_back(relabel, row * width, std::min(height, row + strip_rows) * width);
+    }
+    relabel(0, std::min(height, strip_rows) * width);
+    for (std::thread& th : threads) {
+        th.join();
+    }
+
+    return count;
+}
+
+int label_components(const std::vector<uint8_t>& mask, long width, long height, int num_threads, std::vector<int>& labels) {
+    FrameArena arena;
+    labels.assign(width * height, 0);
+    return label_components(mask.data(), width, height, num_threads, labels.data(), arena);
+}
 
-        if (sum_intensity > 0) {
-            cluster.x_centroid = sum_x / sum_intensity;
-            cluster.y_centroid = sum_y / sum_intensity;
-            cluster.total_intensity = sum_intensity;
+// Threshold, label and centroid a frame held in its native pixel type, rows
+// stride elements apart. data's vectors are reused; all other memory comes
+// from arena.
+template <typename T>
+static void detect_clusters(const T* pixels, long stride, const DetectionOptions& options, ImageData& data, FrameArena& arena) {
+    const long num_pixels = data.width * data.height;
+
+    // statistics and mask
+    data.pixels_mask.resize(num_pixels);
+    if (options.local_background) {
+        threshold_local(pixels, stride, options, data, arena);
+    } else {
+        threshold_global(pixels, stride, options, data, arena);
+    }
+
+    // labeling
+    int* labels = arena.allocate<int>(num_pixels);
+    int num_labels = label_components(data.pixels_mask.data(), data.width, data.height, options.num_threads, labels, arena);
+
+    // accumulate moments in a flat array indexed by label - 1
+    ClusterMoments* moments = arena.allocate<ClusterMoments>(num_labels);
+    for (long y = 0; y < data.height; ++y) {
+        const int* row_labels = labels + y * data.width;
+        const T* row = pixels + y * stride;
+        for (long x = 0; x < data.width; ++x) {
+            int label = row_labels[x];
+            if (label != 0) {
+                // promote to floating point only here, when summing into the cluster
+                moments[label - 1].add(x, y, static_cast<double>(row[x]));
+            }
         }
     }
 
-    // keep top 50 brightest clusters
-    std::sort(data.clusters.begin(), data.clusters.end(), [](const Cluster& a, const Cluster& b) {
-        return a.total_intensity > b.total_intensity;
-    });
-    if (data.clusters.size() > 50) {
-        data.clusters.resize(50);
+    // keep the brightest clusters without sorting all of them
+    int* order = arena.allocate<int>(num_labels);
+    for (int l = 0; l < num_labels; ++l) {
+        order[l] = l;
+    }
+    auto brighter = [&](int a, int b) {
+        if (moments[a].sum_w != moments[b].sum_w) return moments[a].sum_w > moments[b].sum_w;
+        return a < b;
+    };
+    size_t keep = std::min(options.max_clusters, static_cast<size_t>(num_labels));
+    INSTRUMENT_COUNT(COUNTER_CLUSTERS_FOUND, num_labels);
+    INSTRUMENT_COUNT(COUNTER_CLUSTERS_DROPPED, num_labels - keep);
+    std::nth_element(order, order + keep, order + num_labels, brighter);
+    std::sort(order, order + keep, brighter);
+
+    data.clusters.resize(keep);
+    for (size_t k = 0; k < keep; ++k) {
+        fill_cluster(data.clusters[k], order[k] + 1, moments[order[k]]);
+    }
+
+    // pixel lists only for the kept clusters, and only on request
+    if (options.keep_pixels) {
+        int* label_to_cluster = arena.allocate<int>(num_labels + 1);
+        std::fill(label_to_cluster, label_to_cluster + num_labels + 1, -1);
+        for (size_t k = 0; k < keep; ++k) {
+            label_to_cluster[order[k] + 1] = k;
+            data.clusters[k].pixels.reserve(moments[order[k]].pixel_count);
+        }
+        for (long y = 0; y < data.height; ++y) {
+            for (long x = 0; x < data.width; ++x) {
+                int k = label_to_cluster[labels[y * data.width + x]];
+                if (k >= 0) {
+                    data.clusters[k].pixels.push_back(Pixel{x, y, static_cast<double>(pixels[y * stride + x])});
+                }
+            }
+        }
     }
 
     // Debug: Print the top 3 to see if they look real
@@ -160,8 +788,685 @@ ImageData fits_to_data(const std::string& filename) {
     //             << data.clusters[i].y_centroid << ") Intensity: " 
     //             << data.clusters[i].total_intensity << std::endl;
     // }
+}
+
+ImageData fits_to_data(const std::string& filename) {
+    return fits_to_data(filename, DetectionOptions());
+}
+
+ImageData fits_to_data(const std::string& filename, const DetectionOptions& options) {
+    FrameBuffer frame;
+    if (!fits_read_frame(filename, 0, frame)) {
+        return ImageData();
+    }
+    return detect_frame(frame, options);
+}
+
+bool fits_to_data(const std::string& filename, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data) {
+    if (!fits_read_frame(filename, 0, workspace.frame)) {
+        return false;
+    }
+    return detect_frame(workspace.frame, options, workspace, data);
+}
+
+ImageData fits_to_data_memory(const void* fits_data, size_t size, const DetectionOptions& options) {
+    FrameBuffer frame;
+    if (!fits_read_frame_memory(fits_data, size, 0, frame)) {
+        return ImageData();
+    }
+    return detect_frame(frame, options);
+}
+
+bool fits_to_data_memory(const void* fits_data, size_t size, const DetectionOptions& options,
+                         DetectionWorkspace& workspace, ImageData& data) {
+    if (!fits_read_frame_memory(fits_data, size, 0, workspace.frame)) {
+        return false;
+    }
+    return detect_frame(workspace.frame, options, workspace, data);
+}
+
+// Days from 1970-01-01 to the given civil date (proleptic Gregorian)
+static long days_from_civil(long y, long m, long d) {
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// DATE-OBS in seconds since 1970, 0 if missing or unparsable
+static double header_time(fitsfile* fptr) {
+    char date[FLEN_VALUE] = {0};
+    int status = 0;
+    if (fits_read_key(fptr, TSTRING, "DATE-OBS", date, nullptr, &status)) {
+        return 0.0;
+    }
+
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0;
+    double second = 0.0;
+    if (fits_str2time(date, &year, &month, &day, &hour, &minute, &second, &status)) {
+        return 0.0;
+    }
+    return days_from_civil(year, month, day) * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+}
+
+long fits_plane_count(const std::string& filename) {
+    fitsfile *fptr;
+    int status = 0;
+    int bitpix = 0;
+    int naxis = 0;
+    long naxes[3] = {1, 1, 1};
+
+    if (fits_open_file(&fptr, filename.c_str(), READONLY, &status)) {
+        fits_report_error(stderr, status);
+        return 0;
+    }
+
+    fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status);
+    fits_close_file(fptr, &status);
+    if (status) {
+        fits_report_error(stderr, status);
+        return 0;
+    }
+
+    if (naxis == 2) return 1;
+    if (naxis == 3) return naxes[2];
+    std::cerr << "Error: " << filename << " has " << naxis << " axes, expected an image or a cube." << std::endl;
+    return 0;
+}
+
+// Reads plane of an open image into frame and closes fptr; name is only used in messages
+static bool read_plane(fitsfile* fptr, const std::string& name, long plane, FrameBuffer& frame) {
+    INSTRUMENT_SCOPE(STAGE_READ);
+    int status = 0;
+    int bitpix = 0;
+    int naxis = 0;
+    long naxes[3] = {1, 1, 1};
+
+    int equivtype = 0;
+    if (fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status) ||
+        fits_get_img_equivtype(fptr, &equivtype, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    if ((naxis != 2 && naxis != 3) || plane < 0 || plane >= (naxis == 3 ? naxes[2] : 1)) {
+        std::cerr << "Error: " << name << " has no image plane " << plane << "." << std::endl;
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    frame.width = naxes[0];
+    frame.height = naxes[1];
+    frame.pixel_type = equivtype;
+    const long num_pixels = frame.width * frame.height;
+
+    bool ok = false;
+    with_pixel_type(equivtype, [&](auto pixel) {
+        typedef decltype(pixel) T;
+        frame.pixels.resize(num_pixels * sizeof(T));
+        long fpixel[3] = {1, 1, plane + 1};
+        int anynul = 0;
+
+        if (fits_read_pix(fptr, PixelTraits<T>::datatype, fpixel, num_pixels, nullptr, frame.pixels.data(), &anynul, &status)) {
+            fits_report_error(stderr, status);
+            return;
+        }
+        ok = true;
+    });
+
+    frame.timestamp = header_time(fptr);
+    if (frame.timestamp > 0 && plane > 0) {
+        double exposure = 0.0;
+        int key_status = 0;
+        if (fits_read_key(fptr, TDOUBLE, "EXPTIME", &exposure, nullptr, &key_status) == 0) {
+            frame.timestamp += plane * exposure;
+        }
+    }
+
+    fits_close_file(fptr, &status);
+    return ok;
+}
+
+bool fits_read_frame(const std::string& filename, long plane, FrameBuffer& frame) {
+    fitsfile *fptr;
+    int status = 0;
+    if (fits_open_file(&fptr, filename.c_str(), READONLY, &status)) {
+        fits_report_error(stderr, status);
+        return false;
+    }
+    return read_plane(fptr, filename, plane, frame);
+}
+
+bool fits_read_frame_memory(const void* fits_data, size_t size, long plane, FrameBuffer& frame) {
+    fitsfile *fptr;
+    int status = 0;
+    // READONLY with no realloc function, so CFITSIO never writes to the buffer
+    void* memory = const_cast<void*>(fits_data);
+    size_t memory_size = size;
+    if (fits_open_memfile(&fptr, "memory.fits", READONLY, &memory, &memory_size, 0, nullptr, &status)) {
+        fits_report_error(stderr, status);
+        return false;
+    }
+    return read_plane(fptr, "in-memory FITS", plane, frame);
+}
+
+bool fits_write_frame(const std::string& filename, const FrameBuffer& frame) {
+    fitsfile *fptr;
+    int status = 0;
+    long naxes[2] = {frame.width, frame.height};
+
+    // a leading ! tells CFITSIO to overwrite an existing file
+    if (fits_create_file(&fptr, ("!" + filename).c_str(), &status)) {
+        fits_report_error(stderr, status);
+        return false;
+    }
+
+    bool ok = false;
+    with_pixel_type(frame.pixel_type, [&](auto pixel) {
+        typedef decltype(pixel) T;
+        if (frame.pixels.size() != frame.width * frame.height * sizeof(T)) {
+            std::cerr << "Error: frame buffer does not match its size and pixel type." << std::endl;
+            return;
+        }
+
+        long fpixel[2] = {1, 1};
+        void* pixels = const_cast<uint8_t*>(frame.pixels.data());
+        if (fits_create_img(fptr, frame.pixel_type, 2, naxes, &status) ||
+            fits_write_pix(fptr, PixelTraits<T>::datatype, fpixel, frame.width * frame.height, pixels, &status)) {
+            fits_report_error(stderr, status);
+            return;
+        }
+        ok = true;
+    });
+
+    if (ok && frame.timestamp > 0) {
+        time_t seconds = static_cast<time_t>(frame.timestamp);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char date[FLEN_VALUE];
+        snprintf(date, sizeof(date), "%04d-%02d-%02dT%02d:%02d:%06.3f", utc.tm_year + 1900, utc.tm_mon + 1,
+                 utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec + (frame.timestamp - seconds));
+        if (fits_write_key(fptr, TSTRING, "DATE-OBS", date, "UTC start of exposure", &status)) {
+            fits_report_error(stderr, status);
+            ok = false;
+        }
+    }
+
+    fits_close_file(fptr, &status);
+    return ok && status == 0;
+}
+
+// Sizes and checks a frame of pixel_type pixels (as with_pixel_type maps it)
+// with rows stride_bytes apart, then runs detect_clusters on it
+static bool detect_pixels(const void* pixels, long width, long height, long stride_bytes, int pixel_type,
+                          const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data) {
+    INSTRUMENT_SCOPE(STAGE_DETECT);
+    INSTRUMENT_COUNT(COUNTER_FRAMES_DETECTED, 1);
+    workspace.arena.reset();
+    data.width = width;
+    data.height = height;
+    data.intensity_mean = 0.0;
+    data.intensity_standard_deviation = 0.0;
+    data.intensity_threshold = 0.0;
+
+    bool ok = false;
+    with_pixel_type(pixel_type, [&](auto pixel) {
+        typedef decltype(pixel) T;
+        const long row_bytes = width * static_cast<long>(sizeof(T));
+        if (stride_bytes == 0) {
+            stride_bytes = row_bytes;
+        }
+        if (width < 0 || height < 0 || stride_bytes < row_bytes || stride_bytes % sizeof(T) != 0 ||
+            (pixels == nullptr && width * height > 0)) {
+            std::cerr << "Error: pixel buffer of " << width << " x " << height << " with a stride of "
+                      << stride_bytes << " bytes is not valid for its pixel type." << std::endl;
+            return;
+        }
+        detect_clusters(static_cast<const T*>(pixels), stride_bytes / static_cast<long>(sizeof(T)), options, data, workspace.arena);
+        ok = true;
+    });
+
+    if (!ok) {
+        data.clusters.clear();
+        data.pixels_mask.clear();
+    }
+    return ok;
+}
+
+ImageData detect_frame(const FrameBuffer& frame, const DetectionOptions& options) {
+    DetectionWorkspace workspace;
+    ImageData data = {};
+    detect_frame(frame, options, workspace, data);
+    return data;
+}
+
+bool detect_frame(const FrameBuffer& frame, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data) {
+    bool size_ok = false;
+    with_pixel_type(frame.pixel_type, [&](auto pixel) {
+        size_ok = frame.pixels.size() == frame.width * frame.height * sizeof(decltype(pixel));
+    });
+    if (!size_ok) {
+        std::cerr << "Error: frame buffer does not match its size and pixel type." << std::endl;
+        data.clusters.clear();
+        return false;
+    }
+    return detect_pixels(frame.pixels.data(), frame.width, frame.height, 0, frame.pixel_type, options, workspace, data);
+}
+
+// Pixel types whose in-memory layout is the C type with_pixel_type picks for them
+static bool native_pixel_type(int pixel_type) {
+    switch (pixel_type) {
+        case BYTE_IMG:
+        case SHORT_IMG:
+        case USHORT_IMG:
+        case LONG_IMG:
+        case FLOAT_IMG:
+        case DOUBLE_IMG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+ImageData detect_frame(const PixelBuffer& pixels, const DetectionOptions& options) {
+    DetectionWorkspace workspace;
+    ImageData data = {};
+    detect_frame(pixels, options, workspace, data);
+    return data;
+}
+
+bool detect_frame(const PixelBuffer& pixels, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data) {
+    if (!native_pixel_type(pixels.pixel_type)) {
+        std::cerr << "Error: unsupported pixel type " << pixels.pixel_type << " for a pixel buffer." << std::endl;
+        data.clusters.clear();
+        return false;
+    }
+    return detect_pixels(pixels.data, pixels.width, pixels.height, pixels.stride, pixels.pixel_type, options, workspace, data);
+}
+
+// --- Streaming detection ---
+
+// Horizontal run of foreground pixels [start, end) and the component it belongs to
+struct Run {
+    long start;
+    long end;
+    int component;
+};
+
+template <typename T>
+static bool stream_clusters(fitsfile* fptr, const DetectionOptions& options, long band_rows, ImageData& data,
+                            const std::function<void(const Cluster&)>& on_cluster) {
+    int status = 0;
+    const long width = data.width;
+    const long height = data.height;
+    const long tile = std::max(1L, options.tile_size);
+    const long tiles_x = (width + tile - 1) / tile;
+    const long tiles_y = (height + tile - 1) / tile;
+
+    // whole tile rows per band, so the statistics come out as in detect_frame
+    band_rows = std::max(1L, std::min(band_rows, height));
+    band_rows = (band_rows + tile - 1) / tile * tile;
+
+    std::vector<T> band(width * band_rows);
+    int anynul = 0;
+    auto read_band = [&](long y0, long rows) {
+        long fpixel[2] = {1, y0 + 1};
+        if (fits_read_pix(fptr, PixelTraits<T>::datatype, fpixel, width * rows, nullptr, band.data(), &anynul, &status)) {
+            fits_report_error(stderr, status);
+            return false;
+        }
+        return true;
+    };
+
+    // pass 1: tile statistics, combined in the same order as threshold_global
+    // and threshold_local
+    std::vector<TileStats> tiles(options.local_background ? tiles_x * tiles_y : 0);
+    TileStats total;
+    TileSums<T> sums;
+    for (long y0 = 0; y0 < height; y0 += band_rows) {
+        long rows = std::min(band_rows, height - y0);
+        if (!read_band(y0, rows)) return false;
+        for (long ty0 = 0; ty0 < rows; ty0 += tile) {
+            long h = std::min(tile, rows - ty0);
+            if (options.local_background) {
+                local_tile_row(band.data(), width, width, ty0, h, options, tiles.data() + (y0 + ty0) / tile * tiles_x, total);
+                continue;
+            }
+            for (long x0 = 0; x0 < width; x0 += tile) {
+                long w = std::min(tile, width - x0);
+                sweep_tile(band.data(), width, x0, ty0, w, h, T(), nullptr, 0, sums);
+                combine_stats(total, sums_to_stats(sums, w * h));
+            }
+        }
+    }
+    if (options.local_background) {
+        set_local_statistics(data, total);
+    } else {
+        set_threshold(data, total.mean, std::sqrt(total.m2 / std::max(1L, total.count)), std::max(0.0, total.max));
+    }
+    const auto threshold = native_threshold<T>(data.intensity_threshold);
+
+    std::vector<long> col_t0, col_t1;
+    std::vector<double> col_w, bg_col, noise_col, row_threshold;
+    if (options.local_background) {
+        col_t0.resize(width);
+        col_t1.resize(width);
+        col_w.resize(width);
+        for (long x = 0; x < width; ++x) {
+            tile_coord(x, tile, tiles_x, col_t0[x], col_t1[x], col_w[x]);
+        }
+        bg_col.resize(tiles_x);
+        noise_col.resize(tiles_x);
+        row_threshold.resize(width);
+    }
+    std::vector<uint8_t> row_mask(width);
+
+    // pass 2: label runs row by row against the previous row (4-connectivity).
+    // A component is numbered when its first run appears, i.e. in raster
+    // order of its first pixel, and keeps the lower number when two meet.
+    std::vector<ClusterMoments> moments;
+    std::vector<int> component_id;
+    std::vector<long> touched_row; // last row a component got a run in
+    std::vector<int> free_components;
+    std::vector<Run> prev_runs;
+    std::vector<Run> cur_runs;
+    prev_runs.reserve(width / 2 + 1);
+    cur_runs.reserve(width / 2 + 1);
+    int next_id = 1;
+
+    auto new_component = [&]() {
+        int c;
+        if (!free_components.empty()) {
+            c = free_components.back();
+            free_components.pop_back();
+            moments[c] = ClusterMoments();
+        } else {
+            c = moments.size();
+            moments.emplace_back();
+            component_id.push_back(0);
+            touched_row.push_back(-1);
+        }
+        component_id[c] = next_id++;
+        return c;
+    };
+
+    auto emit = [&](int c, long row) {
+        on_cluster(moments_to_cluster(component_id[c], moments[c]));
+        free_components.push_back(c);
+        touched_row[c] = row; // so further runs of the same component are skipped
+    };
+
+    for (long y0 = 0; y0 < height; y0 += band_rows) {
+        long rows = std::min(band_rows, height - y0);
+        if (!read_band(y0, rows)) return false;
+
+        for (long r = 0; r < rows; ++r) {
+            const long y = y0 + r;
+            const T* row = band.data() + r * width;
+            if (options.local_background) {
+                local_row_threshold(tiles.data(), tiles_x, tiles_y, tile, y, width, col_t0.data(), col_t1.data(),
+                                    col_w.data(), bg_col.data(), noise_col.data(), row_threshold.data());
+                for (long x = 0; x < width; ++x) {
+                    row_mask[x] = (row[x] >= row_threshold[x]);
+                }
+            } else {
+                for (long x = 0; x < width; ++x) {
+                    row_mask[x] = (row[x] >= threshold);
+                }
+            }
+
+            cur_runs.clear();
+            size_t p = 0; // first previous run that can still overlap
+            long x = 0;
+            while (x < width) {
+                if (!row_mask[x]) {
+                    ++x;
+                    continue;
+                }
+                long start = x;
+                while (x < width && row_mask[x]) {
+                    ++x;
+                }
+                Run run = {start, x, -1};
+
+                while (p < prev_runs.size() && prev_runs[p].end <= start) {
+                    ++p;
+                }
+                for (size_t q = p; q < prev_runs.size() && prev_runs[q].start < run.end; ++q) {
+                    int other = prev_runs[q].component;
+                    if (run.component == -1) {
+                        run.component = other;
+                    } else if (other != run.component) {
+                        // two components meet: fold other into ours and repoint its runs
+                        moments[run.component].merge(moments[other]);
+                        component_id[run.component] = std::min(component_id[run.component], component_id[other]);
+                        for (Run& pr : prev_runs) {
+                            if (pr.component == other) pr.component = run.component;
+                        }
+                        for (Run& cr : cur_runs) {
+                            if (cr.component == other) cr.component = run.component;
+                        }
+                        free_components.push_back(other);
+                        touched_row[other] = y;
+                    }
+                }
+                if (run.component == -1) {
+                    run.component = new_component();
+                }
+
+                ClusterMoments& m = moments[run.component];
+                for (long px = start; px < run.end; ++px) {
+                    m.add(px, y, static_cast<double>(row[px]));
+                }
+                touched_row[run.component] = y;
+                cur_runs.push_back(run);
+            }
+
+            // components with no run in this row are finished
+            for (const Run& pr : prev_runs) {
+                if (touched_row[pr.component] != y) {
+                    emit(pr.component, y);
+                }
+            }
+            prev_runs.swap(cur_runs);
+        }
+    }
+
+    for (const Run& pr : prev_runs) {
+        if (touched_row[pr.component] != height) {
+            emit(pr.component, height);
+        }
+    }
+
+    return true;
+}
+
+bool fits_stream_clusters(const std::string& filename, const DetectionOptions& options, long band_rows, ImageData& data,
+                          const std::function<void(const Cluster&)>& on_cluster) {
+    fitsfile *fptr;
+    int status = 0;
+    int bitpix = 0;
+    int naxis = 0;
+    long naxes[2] = {1, 1};
+
+    if (fits_open_file(&fptr, filename.c_str(), READONLY, &status)) {
+        fits_report_error(stderr, status);
+        return false;
+    }
+
+    int equivtype = 0;
+    if (fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status) || naxis != 2 ||
+        fits_get_img_equivtype(fptr, &equivtype, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    data.width = naxes[0];
+    data.height = naxes[1];
+
+    bool ok = false;
+    with_pixel_type(equivtype, [&](auto pixel) {
+        ok = stream_clusters<decltype(pixel)>(fptr, options, band_rows, data, on_cluster);
+    });
 
     fits_close_file(fptr, &status);
+    return ok;
+}
+
+ImageData fits_to_data_streaming(const std::string& filename, const DetectionOptions& options, long band_rows) {
+    ImageData data = {};
+    const size_t keep = options.max_clusters;
+
+    // stream ids grow in raster order of each cluster's first pixel, so they
+    // break ties the way detect_frame's labels do
+    auto brighter = [](const Cluster& a, const Cluster& b) {
+        if (a.total_intensity != b.total_intensity) return a.total_intensity > b.total_intensity;
+        return a.id < b.id;
+    };
+
+    // only ever hold a bounded number of candidates for the brightest, plus
+    // every id to renumber them by at the end
+    std::vector<int> ids;
+    bool ok = fits_stream_clusters(filename, options, band_rows, data, [&](const Cluster& cluster) {
+        ids.push_back(cluster.id);
+        data.clusters.push_back(cluster);
+        if (data.clusters.size() >= 4 * keep + 4) {
+            std::nth_element(data.clusters.begin(), data.clusters.begin() + keep, data.clusters.end(), brighter);
+            data.clusters.resize(keep);
+        }
+    });
+    if (!ok) {
+        data.clusters.clear();
+        return data;
+    }
+
+    std::sort(data.clusters.begin(), data.clusters.end(), brighter);
+    if (data.clusters.size() > keep) {
+        data.clusters.resize(keep);
+    }
+
+    // ids skip the numbers of components that merged into earlier ones;
+    // close the gaps so they match detect_frame's labels
+    std::sort(ids.begin(), ids.end());
+    for (Cluster& cluster : data.clusters) {
+        cluster.id = 1 + (std::lower_bound(ids.begin(), ids.end(), cluster.id) - ids.begin());
+    }
 
     return data;
-}
\ No newline at end of file
+}
+
+
+// --- Window (tracking) detection ---
+
+// Centroid of the component around the brightest pixel of a window, or false
+// if that pixel is not above the window's background + THRESHOLD_CONSTANT * noise
+template <typename T>
+static bool centroid_window(const T* pixels, long w, long h, long x_offset, long y_offset,
+                            const DetectionOptions& options, std::vector<long>& stack,
+                            std::vector<uint8_t>& visited, Cluster& cluster) {
+    TileStats st = tile_stats(pixels, w, 0, 0, w, h, options.clip_sigma, options.clip_iterations);
+    const double threshold = st.background + THRESHOLD_CONSTANT * std::max(st.noise, noise_floor<T>(st.background));
+
+    // strictly above, so a flat window (threshold == background) has no star
+    long peak = std::max_element(pixels, pixels + w * h) - pixels;
+    if (!(pixels[peak] > threshold)) {
+        return false;
+    }
+
+    // flood fill the 4-connected pixels above threshold around the peak
+    ClusterMoments m;
+    visited.assign(w * h, 0);
+    stack.clear();
+    stack.push_back(peak);
+    visited[peak] = 1;
+    while (!stack.empty()) {
+        long i = stack.back();
+        stack.pop_back();
+        long x = i % w;
+        long y = i / w;
+        m.add(x + x_offset, y + y_offset, static_cast<double>(pixels[i]));
+
+        const long neighbours[4] = {x > 0 ? i - 1 : -1, x + 1 < w ? i + 1 : -1,
+                                    y > 0 ? i - w : -1, y + 1 < h ? i + w : -1};
+        for (long n : neighbours) {
+            if (n >= 0 && !visited[n] && pixels[n] > threshold) {
+                visited[n] = 1;
+                stack.push_back(n);
+            }
+        }
+    }
+
+    cluster = moments_to_cluster(cluster.id, m);
+    return true;
+}
+
+WindowDetection fits_to_data_windows(const std::string& filename, const std::vector<PixelWindow>& windows,
+                                     size_t min_found, const DetectionOptions& options) {
+    WindowDetection result;
+
+    fitsfile *fptr;
+    int status = 0;
+    int bitpix = 0;
+    int naxis = 0;
+    long naxes[2] = {1, 1};
+
+    if (fits_open_file(&fptr, filename.c_str(), READONLY, &status)) {
+        fits_report_error(stderr, status);
+        return result;
+    }
+
+    int equivtype = 0;
+    if (fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status) || naxis != 2 ||
+        fits_get_img_equivtype(fptr, &equivtype, &status)) {
+        fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
+        return result;
+    }
+
+    with_pixel_type(equivtype, [&](auto pixel) {
+        typedef decltype(pixel) T;
+        std::vector<T> buffer;
+        std::vector<long> stack;
+        std::vector<uint8_t> visited;
+
+        for (size_t w = 0; w < windows.size(); ++w) {
+            // clip the window to the image
+            long x0 = std::max(0L, windows[w].x);
+            long y0 = std::max(0L, windows[w].y);
+            long x1 = std::min(naxes[0], windows[w].x + windows[w].width);
+            long y1 = std::min(naxes[1], windows[w].y + windows[w].height);
+            if (x1 <= x0 || y1 <= y0) {
+                continue;
+            }
+
+            long fpixel[2] = {x0 + 1, y0 + 1};
+            long lpixel[2] = {x1, y1};
+            long inc[2] = {1, 1};
+            int anynul = 0;
+            buffer.resize((x1 - x0) * (y1 - y0));
+            if (fits_read_subset(fptr, PixelTraits<T>::datatype, fpixel, lpixel, inc, nullptr, buffer.data(), &anynul, &status)) {
+                fits_report_error(stderr, status);
+                status = 0;
+                continue;
+            }
+
+            Cluster cluster = {static_cast<int>(w), {}, 0.0, 0.0, 0.0};
+            if (centroid_window(buffer.data(), x1 - x0, y1 - y0, x0, y0, options, stack, visited, cluster)) {
+                result.clusters.push_back(cluster);
+            }
+        }
+    });
+
+    fits_close_file(fptr, &status);
+
+    if (result.clusters.size() < min_found) {
+        result.full_frame = true;
+        result.clusters = fits_to_data(filename, options).clusters;
+    }
+
+    return result;
+}
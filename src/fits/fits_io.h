@@ -2,6 +2,13 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
 
 #define THRESHOLD_CONSTANT 5.0
 
@@ -18,10 +25,68 @@ struct Cluster {
     double x_centroid;
     double y_centroid;
     double total_intensity;
+
+    long pixel_count = 0;
+    long x_min = 0, y_min = 0, x_max = 0, y_max = 0; // bounding box, inclusive
+
+    // intensity-weighted central second moments (spot shape)
+    double xx_moment = 0.0;
+    double yy_moment = 0.0;
+    double xy_moment = 0.0;
+};
+
+// Running intensity-weighted sums of one connected component
+struct ClusterMoments {
+    double sum_w = 0.0;
+    double sum_wx = 0.0;
+    double sum_wy = 0.0;
+    double sum_wxx = 0.0;
+    double sum_wyy = 0.0;
+    double sum_wxy = 0.0;
+    long pixel_count = 0;
+    long x_min = 0, y_min = 0, x_max = -1, y_max = -1;
+
+    void add(long x, long y, double w) {
+        sum_w += w;
+        sum_wx += x * w;
+        sum_wy += y * w;
+        sum_wxx += x * (x * w);
+        sum_wyy += y * (y * w);
+        sum_wxy += x * (y * w);
+
+        if (pixel_count == 0) {
+            x_min = x_max = x;
+            y_min = y_max = y;
+        } else {
+            x_min = std::min(x_min, x);
+            x_max = std::max(x_max, x);
+            y_min = std::min(y_min, y);
+            y_max = std::max(y_max, y);
+        }
+        pixel_count++;
+    }
+
+    void merge(const ClusterMoments& other) {
+        if (other.pixel_count == 0) return;
+        if (pixel_count == 0) {
+            *this = other;
+            return;
+        }
+        sum_w += other.sum_w;
+        sum_wx += other.sum_wx;
+        sum_wy += other.sum_wy;
+        sum_wxx += other.sum_wxx;
+        sum_wyy += other.sum_wyy;
+        sum_wxy += other.sum_wxy;
+        x_min = std::min(x_min, other.x_min);
+        x_max = std::max(x_max, other.x_max);
+        y_min = std::min(y_min, other.y_min);
+        y_max = std::max(y_max, other.y_max);
+        pixel_count += other.pixel_count;
+    }
 };
 
 struct ImageData {
-    std::vector<double> pixels;
     long width;
     long height;
 
@@ -29,34 +94,239 @@ struct ImageData {
     double intensity_standard_deviation;
 
     double intensity_threshold;
-    std::vector<bool> pixels_mask; // 1 if star, 0 otherwise
+    std::vector<uint8_t> pixels_mask; // 1 if star, 0 otherwise
 
     std::vector<Cluster> clusters;
 };
 
 struct UnionFind{
-    std::vector<int> parent;
-    
-    UnionFind(int size) : parent(size) {
-        for (int i = 0; i < size; ++i) {
+    int* parent;
+    int size;
+    std::vector<int> storage; // owned parent array, unless built over a caller's buffer
+
+    UnionFind(int n) : storage(n) {
+        init(storage.data(), n);
+    }
+
+    // parent array of n entries supplied by the caller (e.g. from a FrameArena)
+    UnionFind(int* array, int n) {
+        init(array, n);
+    }
+
+    UnionFind(const UnionFind&) = delete;
+    UnionFind& operator=(const UnionFind&) = delete;
+
+    void init(int* array, int n) {
+        parent = array;
+        size = n;
+        for (int i = 0; i < n; ++i) {
             parent[i] = i;
         }
     }
 
+    // iterative with path halving, so long chains cannot overflow the stack
     int find(int x) {
-        if (parent[x] != x) {
-            parent[x] = find(parent[x]);
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
         }
-        return parent[x];
+        return x;
     }
 
+    // the smaller label becomes the root
     void unite(int x, int y) {
         int rx = find(x);
         int ry = find(y);
-        if (rx != ry) {
+        if (rx < ry) {
             parent[ry] = rx;
+        } else if (ry < rx) {
+            parent[rx] = ry;
+        }
+    }
+};
+
+struct DetectionOptions {
+    int num_threads = 1;       // threads for connected-component labeling
+    size_t max_clusters = 50;  // keep only this many of the brightest clusters
+    bool keep_pixels = false;  // also fill Cluster::pixels for the kept clusters
+
+    // Statistics are gathered per tile_size x tile_size tile. With
+    // local_background the mask compares each pixel against an interpolated
+    // sigma-clipped background + THRESHOLD_CONSTANT * local noise, instead of
+    // the global mean + THRESHOLD_CONSTANT * stddev.
+    bool local_background = false;
+    long tile_size = 64;
+    double clip_sigma = 3.0;
+    int clip_iterations = 3;
+};
+
+// One image plane held in memory in the file's native pixel type, so reading
+// and detection can run on different threads
+struct FrameBuffer {
+    long width = 0;
+    long height = 0;
+    int pixel_type = 0;          // equivalent BITPIX (BYTE_IMG, USHORT_IMG, FLOAT_IMG, ...)
+    std::vector<uint8_t> pixels; // width * height values of that type, row-major
+
+    // seconds since 1970-01-01 UTC: DATE-OBS plus plane * EXPTIME for cubes,
+    // 0 if the header has no DATE-OBS
+    double timestamp = 0.0;
+};
+
+// Pixels owned by someone else, e.g. a camera driver's frame buffer. Read in
+// place, never copied; rows may be padded.
+struct PixelBuffer {
+    const void* data = nullptr;
+    long width = 0;
+    long height = 0;
+    long stride = 0;    // bytes from one row to the next, 0 = width * pixel size
+    int pixel_type = 0; // BYTE_IMG, SHORT_IMG, USHORT_IMG, LONG_IMG, FLOAT_IMG or DOUBLE_IMG, host byte order
+};
+
+// Bump allocator for per-frame scratch arrays. Everything handed out stays
+// valid until reset(). When a frame asks for more than the block holds, the
+// rest comes from the heap and the next reset() grows the block to that
+// frame's total, so once the largest frame has been seen nothing is allocated.
+struct FrameArena {
+    std::unique_ptr<unsigned char[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t requested = 0; // bytes asked for since the last reset, overflow included
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+
+    // Space for count objects of T. Trivially constructible types are left
+    // uninitialized, anything else is value-initialized. Nothing is destroyed.
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "over-aligned type");
+
+        const size_t bytes = count * sizeof(T);
+        requested += bytes + alignof(T);
+        size_t offset = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+        unsigned char* memory;
+        if (offset + bytes <= capacity) {
+            memory = block.get() + offset;
+            used = offset + bytes;
+        } else {
+            overflow.emplace_back(new unsigned char[bytes > 0 ? bytes : 1]);
+            memory = overflow.back().get();
+        }
+
+        T* objects = reinterpret_cast<T*>(memory);
+        if (!std::is_trivially_default_constructible<T>::value) {
+            for (size_t i = 0; i < count; ++i) {
+                new (objects + i) T();
+            }
+        }
+        return objects;
+    }
+
+    void reset() {
+        if (requested > capacity) {
+            block.reset(new unsigned char[requested]);
+            capacity = requested;
         }
+        overflow.clear();
+        used = 0;
+        requested = 0;
     }
 };
 
+// Scratch state for detecting frame after frame without touching the heap:
+// pass the same workspace and the same ImageData to every call. Buffers
+// adapt to the largest frame seen. Not shared between threads.
+struct DetectionWorkspace {
+    FrameArena arena;
+    FrameBuffer frame; // file reads land here (see fits_to_data below)
+};
+
+// Predicted star position: pixel rectangle with its top-left corner at (x, y), 0-based
+struct PixelWindow {
+    long x;
+    long y;
+    long width;
+    long height;
+};
+
+struct WindowDetection {
+    std::vector<Cluster> clusters; // Cluster::id is the window index, unless full_frame
+    bool full_frame = false;       // too few windows held a star; clusters come from fits_to_data
+};
+
+// Labels the 4-connected components of mask (row-major, width x height).
+// Components are numbered 1..n in raster order of their first pixel and
+// background is 0, so the result is the same for any num_threads: the image
+// is split into horizontal strips labeled in parallel, then equivalences
+// along strip borders are merged. Returns n.
+int label_components(const std::vector<uint8_t>& mask, long width, long height, int num_threads, std::vector<int>& labels);
+
+// For a data cube this detects on the first plane
 ImageData fits_to_data(const std::string& filename);
+ImageData fits_to_data(const std::string& filename, const DetectionOptions& options);
+
+// Number of image planes: 1 for a 2-D image, NAXIS3 for a data cube, 0 on error
+long fits_plane_count(const std::string& filename);
+
+// Reads plane (0-based) of a 2-D image or data cube into frame
+bool fits_read_frame(const std::string& filename, long plane, FrameBuffer& frame);
+
+// Writes frame as a 2-D image of its pixel type (overwriting filename), with
+// DATE-OBS if the frame has a timestamp
+bool fits_write_frame(const std::string& filename, const FrameBuffer& frame);
+
+// fits_to_data on a frame that is already in memory
+ImageData detect_frame(const FrameBuffer& frame, const DetectionOptions& options);
+
+// Same detection into a caller-owned result, with all scratch memory taken
+// from workspace. data's mask and cluster vectors keep their capacity, so
+// once warmed up a frame makes no heap allocations (with num_threads = 1
+// and keep_pixels off; worker threads are started per frame).
+bool detect_frame(const FrameBuffer& frame, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data);
+
+// Detection on a PixelBuffer, with the same results as a FrameBuffer holding
+// the same pixels. Returns empty / false for an unsupported pixel type or a
+// stride shorter than a row or not a whole number of pixels.
+ImageData detect_frame(const PixelBuffer& pixels, const DetectionOptions& options);
+bool detect_frame(const PixelBuffer& pixels, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data);
+
+// fits_read_frame on a whole FITS file held in memory (size bytes), e.g.
+// received over a socket; CFITSIO reads the buffer without modifying it
+bool fits_read_frame_memory(const void* fits_data, size_t size, long plane, FrameBuffer& frame);
+
+// fits_to_data on an in-memory FITS file
+ImageData fits_to_data_memory(const void* fits_data, size_t size, const DetectionOptions& options = DetectionOptions());
+bool fits_to_data_memory(const void* fits_data, size_t size, const DetectionOptions& options,
+                         DetectionWorkspace& workspace, ImageData& data);
+
+// fits_read_frame + detect_frame through a workspace. The pixel buffer is
+// reused between calls; CFITSIO's own buffers for opening the file are not.
+bool fits_to_data(const std::string& filename, const DetectionOptions& options, DetectionWorkspace& workspace, ImageData& data);
+
+// Streams the frame in bands of band_rows rows (rounded up to whole tile
+// rows): one pass for the tile statistics and one for single-pass run
+// labeling that only keeps the runs of two rows. Thresholds are the ones
+// detect_frame uses for options, local_background included. Each component
+// is handed to on_cluster as soon as it closes, with its centroid filled in
+// and no pixel list; ids increase in raster order of the first pixel but skip
+// the ids of components that merged into earlier ones. Frame size and
+// statistics are written to data. Peak memory scales with the image width
+// (plus the tile map with local_background); num_threads and keep_pixels
+// are not used.
+bool fits_stream_clusters(const std::string& filename, const DetectionOptions& options, long band_rows, ImageData& data,
+                          const std::function<void(const Cluster&)>& on_cluster);
+
+// fits_to_data on top of fits_stream_clusters: the same statistics and the
+// same options.max_clusters clusters with the same ids, but pixels_mask and
+// the cluster pixel lists are left empty. Centroids agree to rounding:
+// components that meet sum their moments in another order.
+ImageData fits_to_data_streaming(const std::string& filename, const DetectionOptions& options = DetectionOptions(),
+                                 long band_rows = 64);
+
+
+// Tracking mode: reads only the given windows (CFITSIO section reads) and
+// centroids the star in each one against the window's own sigma-clipped
+// background, without touching the rest of the frame. Falls back to
+// full-frame fits_to_data when fewer than min_found windows hold a star.
+WindowDetection fits_to_data_windows(const std::string& filename, const std::vector<PixelWindow>& windows,
+                                     size_t min_found, const DetectionOptions& options = DetectionOptions());
\ No newline at end of file
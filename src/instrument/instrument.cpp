@@ -0,0 +1,246 @@
+#include <sstream>
+#include <atomic>
+#include <cstring>
+
+#include "instrument.h"
+
+static const char* const counter_names[NUM_COUNTERS] = {
+    "frames_detected",
+    "clusters_found",
+    "clusters_dropped",
+    "threshold_clamped",
+    "triangle_lookups",
+    "lookup_candidates",
+    "lookup_matches",
+    "triples_tried",
+    "hypotheses",
+    "verify_attempts",
+    "verified_stars",
+    "solved",
+    "unsolved",
+    "tracked",
+    "track_fallbacks",
+};
+
+static const char* const stage_names[NUM_STAGES] = {
+    "read",
+    "detect",
+    "convert",
+    "identify",
+    "verify",
+    "attitude",
+    "solve",
+    "track",
+};
+
+// 1-2-5 steps in microseconds; the last bucket has no bound
+static const uint64_t bucket_bounds_ns[HISTOGRAM_BUCKETS - 1] = {
+    1000, 2000, 5000,
+    10000, 20000, 50000,
+    100000, 200000, 500000,
+    1000000, 2000000, 5000000,
+    10000000, 20000000, 50000000,
+    100000000, 200000000, 500000000,
+    1000000000,
+};
+
+const char* counter_name(Counter counter) {
+    return (counter >= 0 && counter < NUM_COUNTERS) ? counter_names[counter] : "unknown";
+}
+
+const char* stage_name(Stage stage) {
+    return (stage >= 0 && stage < NUM_STAGES) ? stage_names[stage] : "unknown";
+}
+
+double bucket_bound_us(int bucket) {
+    return (bucket >= 0 && bucket < HISTOGRAM_BUCKETS - 1) ? bucket_bounds_ns[bucket] / 1000.0 : 0.0;
+}
+
+// One thread's totals. Only the owning thread writes, so updates are a
+// relaxed load and store rather than a locked read-modify-write; readers may
+// see a slightly stale value but never a torn one.
+struct alignas(64) MetricsBlock {
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+    struct {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total_ns;
+        std::atomic<uint64_t> max_ns;
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    } stages[NUM_STAGES];
+
+    std::atomic<bool> in_use;
+    MetricsBlock* next; // immutable once the block is published
+};
+
+// Blocks are never freed: a thread that exits hands its block (and totals)
+// on to the next thread that starts recording
+static std::atomic<MetricsBlock*> registry(nullptr);
+
+static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static MetricsBlock* acquire_block() {
+    for (MetricsBlock* b = registry.load(std::memory_order_acquire); b != nullptr; b = b->next) {
+        bool expected = false;
+        if (!b->in_use.load(std::memory_order_relaxed) &&
+            b->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return b;
+        }
+    }
+
+    MetricsBlock* b = new MetricsBlock;
+    for (auto& c : b->counters) c.store(0, std::memory_order_relaxed);
+    for (auto& s : b->stages) {
+        s.count.store(0, std::memory_order_relaxed);
+        s.total_ns.store(0, std::memory_order_relaxed);
+        s.max_ns.store(0, std::memory_order_relaxed);
+        for (auto& bucket : s.buckets) bucket.store(0, std::memory_order_relaxed);
+    }
+    b->in_use.store(true, std::memory_order_relaxed);
+
+    b->next = registry.load(std::memory_order_relaxed);
+    while (!registry.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return b;
+}
+
+struct BlockLease {
+    MetricsBlock* block = nullptr;
+
+    ~BlockLease() {
+        if (block) block->in_use.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local BlockLease lease;
+
+static MetricsBlock& thread_block() {
+    if (lease.block == nullptr) {
+        lease.block = acquire_block();
+    }
+    return *lease.block;
+}
+
+void instrument_count(Counter counter, uint64_t n) {
+    bump(thread_block().counters[counter], n);
+}
+
+void instrument_record(Stage stage, uint64_t ns) {
+    auto& s = thread_block().stages[stage];
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && ns > bucket_bounds_ns[bucket]) {
+        ++bucket;
+    }
+    bump(s.count, 1);
+    bump(s.total_ns, ns);
+    bump(s.buckets[bucket], 1);
+    if (ns > s.max_ns.load(std::memory_order_relaxed)) {
+        s.max_ns.store(ns, std::memory_order_relaxed);
+    }
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static void add_block(MetricsSnapshot& snapshot, const MetricsBlock& b) {
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        snapshot.counters[c] += b.counters[c].load(std::memory_order_relaxed);
+    }
+    for (int st = 0; st < NUM_STAGES; ++st) {
+        StageStats& out = snapshot.stages[st];
+        out.count += b.stages[st].count.load(std::memory_order_relaxed);
+        out.total_ns += b.stages[st].total_ns.load(std::memory_order_relaxed);
+        uint64_t max_ns = b.stages[st].max_ns.load(std::memory_order_relaxed);
+        if (max_ns > out.max_ns) out.max_ns = max_ns;
+        for (int k = 0; k < HISTOGRAM_BUCKETS; ++k) {
+            out.buckets[k] += b.stages[st].buckets[k].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+MetricsSnapshot metrics_snapshot() {
+    MetricsSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    for (MetricsBlock* b = registry.load(std::memory_order_acquire); b != nullptr; b = b->next) {
+        add_block(snapshot, *b);
+    }
+    return snapshot;
+}
+
+MetricsSnapshot thread_metrics_snapshot() {
+    MetricsSnapshot snapshot;
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    if (lease.block != nullptr) {
+        add_block(snapshot, *lease.block);
+    }
+    return snapshot;
+}
+
+MetricsSnapshot metrics_difference(const MetricsSnapshot& after, const MetricsSnapshot& before) {
+    MetricsSnapshot diff = after;
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        diff.counters[c] -= before.counters[c];
+    }
+    for (int st = 0; st < NUM_STAGES; ++st) {
+        diff.stages[st].count -= before.stages[st].count;
+        diff.stages[st].total_ns -= before.stages[st].total_ns;
+        for (int k = 0; k < HISTOGRAM_BUCKETS; ++k) {
+            diff.stages[st].buckets[k] -= before.stages[st].buckets[k];
+        }
+    }
+    return diff;
+}
+
+std::string metrics_to_json(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{\n  \"counters\": {";
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        out << (c ? ", " : "") << "\"" << counter_names[c] << "\": " << snapshot.counters[c];
+    }
+    out << "},\n  \"bucket_bounds_us\": [";
+    for (int k = 0; k < HISTOGRAM_BUCKETS - 1; ++k) {
+        out << (k ? ", " : "") << bucket_bound_us(k);
+    }
+    out << "],\n  \"stages\": {\n";
+    for (int st = 0; st < NUM_STAGES; ++st) {
+        const StageStats& s = snapshot.stages[st];
+        out << "    \"" << stage_names[st] << "\": {\"count\": " << s.count
+            << ", \"total_ns\": " << s.total_ns
+            << ", \"max_ns\": " << s.max_ns << ", \"buckets\": [";
+        for (int k = 0; k < HISTOGRAM_BUCKETS; ++k) {
+            out << (k ? ", " : "") << s.buckets[k];
+        }
+        out << "]}" << (st + 1 < NUM_STAGES ? ",\n" : "\n");
+    }
+    out << "  }\n}\n";
+    return out.str();
+}
+
+std::string metrics_to_prometheus(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        out << "# TYPE startracker_" << counter_names[c] << "_total counter\n";
+        out << "startracker_" << counter_names[c] << "_total " << snapshot.counters[c] << "\n";
+    }
+
+    out << "# TYPE startracker_stage_duration_seconds histogram\n";
+    for (int st = 0; st < NUM_STAGES; ++st) {
+        const StageStats& s = snapshot.stages[st];
+        uint64_t cumulative = 0;
+        for (int k = 0; k < HISTOGRAM_BUCKETS; ++k) {
+            cumulative += s.buckets[k];
+            out << "startracker_stage_duration_seconds_bucket{stage=\"" << stage_names[st] << "\",le=\"";
+            if (k < HISTOGRAM_BUCKETS - 1) {
+                out << bucket_bounds_ns[k] / 1e9;
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "startracker_stage_duration_seconds_sum{stage=\"" << stage_names[st] << "\"} " << s.total_ns / 1e9 << "\n";
+        out << "startracker_stage_duration_seconds_count{stage=\"" << stage_names[st] << "\"} " << s.count << "\n";
+    }
+    return out.str();
+}
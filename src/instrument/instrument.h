@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Per-stage counters and latency histograms. Every thread accumulates into
+// its own block (plain relaxed stores, no shared cache lines); snapshots sum
+// the blocks of all threads without taking a lock. Build with
+// -DNO_INSTRUMENT (make INSTRUMENT=0) to compile the INSTRUMENT_* macros
+// out; snapshots and dumps still work and report zeros.
+
+enum Counter {
+    COUNTER_FRAMES_DETECTED,
+    COUNTER_CLUSTERS_FOUND,     // connected components above the threshold
+    COUNTER_CLUSTERS_DROPPED,   // components beyond DetectionOptions::max_clusters
+    COUNTER_THRESHOLD_CLAMPED,  // frames where mean + THRESHOLD_CONSTANT * stddev exceeded the max
+    COUNTER_TRIANGLE_LOOKUPS,
+    COUNTER_LOOKUP_CANDIDATES,  // table entries examined by the lookups
+    COUNTER_LOOKUP_MATCHES,     // entries within TOLERANCE_RAD on all three sides
+    COUNTER_TRIPLES_TRIED,
+    COUNTER_HYPOTHESES,         // triples with a consistent catalog match
+    COUNTER_VERIFY_ATTEMPTS,    // body stars checked against the catalog during verification
+    COUNTER_VERIFIED_STARS,     // of those, paired with a catalog star
+    COUNTER_SOLVED,
+    COUNTER_UNSOLVED,
+    COUNTER_TRACKED,            // frames identified by association with the predicted attitude
+    COUNTER_TRACK_FALLBACKS,    // track_frame calls that went to the lost-in-space solver
+    NUM_COUNTERS
+};
+
+enum Stage {
+    STAGE_READ,      // FITS read into a frame buffer
+    STAGE_DETECT,    // threshold, labeling and centroids
+    STAGE_CONVERT,   // centroids -> body vectors
+    STAGE_IDENTIFY,  // per solve: triangle lookups and correspondence
+    STAGE_VERIFY,    // per solve: hypothesis verification
+    STAGE_ATTITUDE,  // per solve: final attitude
+    STAGE_SOLVE,     // whole solve_stars call
+    STAGE_TRACK,     // tracking association and attitude, fallback excluded
+    NUM_STAGES
+};
+
+// Latency buckets: upper bounds 1, 2, 5, 10, ... 1,000,000 us, then +Inf
+#define HISTOGRAM_BUCKETS 20
+
+struct StageStats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[HISTOGRAM_BUCKETS]; // non-cumulative
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[NUM_COUNTERS];
+    StageStats stages[NUM_STAGES];
+};
+
+const char* counter_name(Counter counter);
+const char* stage_name(Stage stage);
+
+// Upper bound of bucket b in microseconds, 0 for the +Inf bucket
+double bucket_bound_us(int bucket);
+
+void instrument_count(Counter counter, uint64_t n);
+void instrument_record(Stage stage, uint64_t ns);
+
+// Records the time from construction to destruction against stage
+struct ScopedTimer {
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+
+    explicit ScopedTimer(Stage s) : stage(s), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        instrument_record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+};
+
+// Milliseconds between two steady_clock readings
+double elapsed_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+
+#ifdef NO_INSTRUMENT
+// arguments are still referenced (and then optimized away), so local tallies
+// kept only for the counters do not trigger unused-variable warnings
+#define INSTRUMENT_COUNT(counter, n) ((void)(counter), (void)(n))
+#define INSTRUMENT_RECORD(stage, ns) ((void)(stage), (void)(ns))
+#define INSTRUMENT_SCOPE(stage) ((void)(stage))
+#else
+#define INSTRUMENT_COUNT(counter, n) instrument_count(counter, n)
+#define INSTRUMENT_RECORD(stage, ns) instrument_record(stage, ns)
+#define INSTRUMENT_SCOPE(stage) ScopedTimer INSTRUMENT_CONCAT(instrument_timer_, __LINE__)(stage)
+#endif
+
+// Totals over every thread that has recorded anything (including threads
+// that have exited)
+MetricsSnapshot metrics_snapshot();
+
+// The calling thread's totals only; the difference of two of these around a
+// frame gives that frame's numbers
+MetricsSnapshot thread_metrics_snapshot();
+
+// after - before; max_ns is taken from after
+MetricsSnapshot metrics_difference(const MetricsSnapshot& after, const MetricsSnapshot& before);
+
+std::string metrics_to_json(const MetricsSnapshot& snapshot);
+
+// Prometheus text exposition format: startracker_<counter>_total counters and
+// startracker_stage_duration_seconds histograms labelled by stage
+std::string metrics_to_prometheus(const MetricsSnapshot& snapshot);
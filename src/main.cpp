@@ -4,11 +4,29 @@
 #include <algorithm>
 #include <random>
 #include <cassert>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <climits>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <filesystem>
 
 #include "fits/fits_io.h"
 #include "catalog/catalog.h"
 #include "triangle/triangle.h"
 #include "triad/triad.h"
+#include "database/database.h"
+#include "camera/camera.h"
+#include "solver/solver.h"
+#include "sky/sky_index.h"
+#include "pipeline/pipeline.h"
+#include "pipeline/camera_pool.h"
+#include "synth/synth.h"
+#include "tracking/tracking.h"
+#include "instrument/instrument.h"
+#include "fitsio.h" // CFITSIO, for USHORT_IMG and FLOAT_IMG
 
 // ---------------------------------------------------------
 // Test helpers for robustness checks
@@ -172,7 +190,1100 @@ void test_triad_solver() {
     }
 }
 
-int main() {
+// Every band scan kernel the CPU supports must return the scalar kernel's
+// hits, for every chunk length (so every tail length) and unaligned starts
+static bool test_scan_kernels(std::mt19937& rng) {
+    std::cout << "\n[TEST] Band Scan Kernel Agreement..." << std::endl;
+    std::vector<std::pair<const char*, ScanKernel>> kernels = scan_kernels();
+    std::uniform_real_distribution<float> side(0.0f, 0.05f);
+    std::uniform_real_distribution<float> tolerance(0.001f, 0.02f);
+
+    std::vector<float> b(SCAN_CHUNK + 8), c(SCAN_CHUNK + 8);
+    uint16_t expected[SCAN_CHUNK], hits[SCAN_CHUNK];
+    int bands = 0;
+    for (int round = 0; round < 8; ++round) {
+        for (size_t len = 0; len <= SCAN_CHUNK; ++len) {
+            const size_t offset = rng() % 8;
+            const float obs_b = side(rng);
+            const float obs_c = side(rng);
+            const float tol = tolerance(rng);
+            for (size_t k = 0; k < b.size(); ++k) {
+                b[k] = side(rng);
+                c[k] = side(rng);
+                // some entries right on the tolerance edge
+                if (rng() % 8 == 0) b[k] = obs_b + (rng() % 2 ? tol : -tol);
+                if (rng() % 8 == 0) c[k] = obs_c + (rng() % 2 ? tol : -tol);
+            }
+
+            size_t count = kernels[0].second(b.data() + offset, c.data() + offset, len, obs_b, obs_c, tol, expected);
+            for (size_t k = 1; k < kernels.size(); ++k) {
+                size_t n = kernels[k].second(b.data() + offset, c.data() + offset, len, obs_b, obs_c, tol, hits);
+                if (n != count || !std::equal(hits, hits + n, expected)) {
+                    std::cout << "  FAIL: " << kernels[k].first << " kernel disagrees with scalar on a band of "
+                              << len << " entries." << std::endl;
+                    return false;
+                }
+            }
+            ++bands;
+        }
+    }
+
+    std::cout << "  PASS: " << kernels.size() << " kernel(s) agree on " << bands << " bands:";
+    for (const auto& kernel : kernels) {
+        std::cout << " " << kernel.first;
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+// Whole-sky catalog of uniformly random stars for the pattern tests. Stars
+// closer than min_separation to an earlier one are redrawn, so no two can be
+// confused within the solver's match tolerance.
+static std::vector<Star> build_random_catalog(size_t count, double min_separation, std::mt19937& rng) {
+    std::normal_distribution<double> axis(0.0, 1.0);
+    std::uniform_real_distribution<double> magnitude(1.0, 6.0);
+    const double max_dot = std::cos(min_separation);
+    std::vector<Star> catalog;
+    while (catalog.size() < count) {
+        Star s{static_cast<int>(catalog.size()) + 1, axis(rng), axis(rng), axis(rng), magnitude(rng)};
+        normalize(s);
+        bool separated = std::none_of(catalog.begin(), catalog.end(), [&](const Star& o) {
+            return s.x * o.x + s.y * o.y + s.z * o.z > max_dot;
+        });
+        if (separated) {
+            catalog.push_back(s);
+        }
+    }
+    return catalog;
+}
+
+// cone_query must return exactly the stars a brute-force scan finds, for
+// cones from a fraction of a cell to wider than max_radius (which visit every
+// cell), centered anywhere including on cube edges and corners so they cross
+// faces. find_star_id must find every ID and nothing else, both through the
+// dense table and through the sorted list used when IDs span more than 2^24.
+static bool test_sky_index(const std::vector<Star>& catalog, std::mt19937& rng) {
+    std::cout << "\n[TEST] Sky Index Queries..." << std::endl;
+    SkyIndex index = build_sky_index(catalog, MAX_FOV_RAD);
+
+    std::vector<Star> centers;
+    for (double x : {-1.0, 0.0, 1.0}) {
+        for (double y : {-1.0, 0.0, 1.0}) {
+            for (double z : {-1.0, 0.0, 1.0}) {
+                if (x == 0.0 && y == 0.0 && z == 0.0) continue;
+                Star c{0, x, y, z, 0.0};
+                normalize(c);
+                centers.push_back(c);
+            }
+        }
+    }
+    for (int i = 0; i < 40; ++i) {
+        centers.push_back(random_star(0, rng));
+    }
+
+    const double radii[] = {0.002, 0.02, 0.5 * MAX_FOV_RAD, MAX_FOV_RAD, 0.5, M_PI};
+    std::vector<uint32_t> found, expected;
+    int cones = 0;
+    for (const Star& c : centers) {
+        for (double radius : radii) {
+            found.clear();
+            cone_query(index, c, radius, found);
+            expected.clear();
+            const double min_dot = std::cos(radius);
+            for (size_t i = 0; i < catalog.size(); ++i) {
+                const Star& s = catalog[i];
+                if (c.x * s.x + c.y * s.y + c.z * s.z >= min_dot) {
+                    expected.push_back(i);
+                }
+            }
+            std::sort(found.begin(), found.end());
+            if (found != expected) {
+                std::cout << "  FAIL: cone of " << radius << " rad at (" << c.x << ", " << c.y << ", " << c.z
+                          << ") found " << found.size() << " stars, expected " << expected.size() << "." << std::endl;
+                return false;
+            }
+            ++cones;
+        }
+    }
+    std::cout << "  PASS: " << cones << " cones match a brute-force scan." << std::endl;
+
+    // IDs with gaps from -5 up; spread 4099 apart they span about 2^25 values
+    for (int spacing : {3, 4099}) {
+        std::vector<Star> stars = catalog;
+        for (size_t i = 0; i < stars.size(); ++i) {
+            stars[i].id = -5 + static_cast<int>(i) * spacing;
+        }
+        std::shuffle(stars.begin(), stars.end(), rng);
+        SkyIndex ids = build_sky_index(stars, MAX_FOV_RAD);
+        const bool sparse = !ids.sparse_ids.empty();
+        bool ok = sparse == (spacing > 3) && sparse != !ids.id_table.empty();
+        for (size_t i = 0; i < stars.size() && ok; ++i) {
+            ok = find_star_id(ids, stars[i].id) == static_cast<long>(i) && find_star_id(ids, stars[i].id + 1) == -1;
+        }
+        for (int missing : {-6, -4, -5 + static_cast<int>(stars.size()) * spacing, INT_MIN, INT_MAX}) {
+            ok = ok && find_star_id(ids, missing) == -1;
+        }
+        if (!ok) {
+            std::cout << "  FAIL: find_star_id on the " << (sparse ? "sparse" : "dense") << " table." << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASS: find_star_id finds every ID, and only those, in the dense and the sparse table." << std::endl;
+    return true;
+}
+
+static bool has_pattern(const std::vector<const PatternEntry*>& found, const PatternEntry* entry) {
+    return std::find(found.begin(), found.end(), entry) != found.end();
+}
+
+// Every stored pattern must come back from its own angles with each ratio
+// pushed just across its nearest bin edge (so lookups have to probe the
+// neighbouring bin), and from a slot reached by probing past the end
+static bool test_pattern_table(const std::vector<Star>& catalog) {
+    std::cout << "\n[TEST] Pattern Table Round Trip..." << std::endl;
+    PatternOptions options;
+    SkyIndex sky = build_sky_index(catalog, options.radius);
+    PatternTable table = build_pattern_table(catalog.data(), catalog.size(), sky, options);
+    if (table.count == 0) {
+        std::cout << "  FAIL: No patterns built." << std::endl;
+        return false;
+    }
+
+    const double nudge = 1e-3 * options.bin;
+    std::vector<const PatternEntry*> found;
+    size_t checked = 0, crossed = 0;
+    for (const PatternEntry& entry : table.entries) {
+        if (entry.key == PATTERN_EMPTY) continue;
+        const Star members[4] = {catalog[entry.stars[0]], catalog[entry.stars[1]], catalog[entry.stars[2]], catalog[entry.stars[3]]};
+        double edges[6];
+        pattern_edges(members, edges);
+
+        double observed[6];
+        std::copy(edges, edges + 6, observed);
+        bool moved = false;
+        for (int k = 0; k < 5; ++k) {
+            double ratio = edges[k] / edges[5];
+            double bin_edge = std::round(ratio / options.bin) * options.bin;
+            double target = bin_edge + (bin_edge > ratio ? nudge : -nudge);
+            if (bin_edge <= 0 || std::abs(target - ratio) > options.ratio_tolerance) continue;
+            observed[k] = target * edges[5];
+            moved = true;
+        }
+        if (!std::is_sorted(observed, observed + 6)) continue; // the nudge swapped two angles
+
+        found.clear();
+        find_patterns(table, observed, 1e-6, found);
+        if (!has_pattern(found, &entry)) {
+            std::cout << "  FAIL: Pattern of stars " << entry.stars[0] << ", " << entry.stars[1] << ", "
+                      << entry.stars[2] << ", " << entry.stars[3] << " not found next to its bin edges." << std::endl;
+            return false;
+        }
+        ++checked;
+        crossed += moved;
+    }
+
+    // A copy of one pattern behind filler slots from its home slot to the
+    // end of an otherwise empty table, so the probe has to wrap to slot 0.
+    // Filler keys use bit 62, which no packed key does.
+    const PatternEntry empty = {PATTERN_EMPTY, {0, 0, 0, 0}, 0.0f};
+    const PatternEntry filler = {1ull << 62, {0, 0, 0, 0}, 0.0f};
+    PatternTable wrapped;
+    wrapped.options = table.options;
+    wrapped.count = 1;
+    wrapped.entries.assign(table.entries.size(), empty);
+    bool wrapped_found = false;
+    for (const PatternEntry& entry : table.entries) {
+        if (entry.key == PATTERN_EMPTY) continue;
+        const Star members[4] = {catalog[entry.stars[0]], catalog[entry.stars[1]], catalog[entry.stars[2]], catalog[entry.stars[3]]};
+        double edges[6];
+        pattern_edges(members, edges);
+
+        // home slot: the only one a lone copy is found from
+        size_t home = 0;
+        for (; home < wrapped.entries.size(); ++home) {
+            wrapped.entries[home] = entry;
+            found.clear();
+            find_patterns(wrapped, edges, 1e-6, found);
+            wrapped.entries[home] = empty;
+            if (!found.empty()) break;
+        }
+        // slots 1 .. home - 1 stay empty, so probing ends
+        if (home < 2 || home == wrapped.entries.size()) continue;
+
+        std::fill(wrapped.entries.begin() + home, wrapped.entries.end(), filler);
+        wrapped.entries[0] = entry;
+        found.clear();
+        find_patterns(wrapped, edges, 1e-6, found);
+        wrapped_found = has_pattern(found, &wrapped.entries[0]);
+        break;
+    }
+    if (!wrapped_found) {
+        std::cout << "  FAIL: Pattern not found after probing past the end of the table." << std::endl;
+        return false;
+    }
+
+    std::cout << "  PASS: " << checked << " of " << table.count << " patterns found, " << crossed
+              << " across a bin edge, and one past the end of the table." << std::endl;
+    return true;
+}
+
+// A view of the catalog through a field of the given radius at attitude
+// truth, with 2 arcsec of noise: the `keep` brightest stars (0 = all) plus
+// false_stars spots of magnitude 4 (ID -1, as RenderOptions draws them) at
+// random directions in the field. Empty if the field holds fewer than
+// min_stars.
+struct ViewCase {
+    const char* name;
+    size_t min_stars;
+    size_t keep;
+    size_t false_stars;
+};
+
+static std::vector<Star> make_view(const SolverDatabase& db, const Quaternion& truth, double field, const ViewCase& view,
+                                   std::mt19937& rng) {
+    Star boresight = rotate_to_inertial(truth, {0, 0.0, 0.0, 1.0, 0.0});
+    std::vector<uint32_t> cone;
+    cone_query(db.sky, boresight, field, cone);
+    if (cone.size() < view.min_stars) return {};
+
+    std::sort(cone.begin(), cone.end(), [&](uint32_t a, uint32_t b) {
+        return db.stars[a].magnitude < db.stars[b].magnitude;
+    });
+    if (view.keep > 0 && cone.size() > view.keep) {
+        cone.resize(view.keep);
+    }
+
+    std::vector<Star> body;
+    for (uint32_t position : cone) {
+        body.push_back(perturb_star(rotate_to_body(truth, db.stars[position]), 1e-5, rng));
+    }
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t f = 0; f < view.false_stars; ++f) {
+        double angle = 0.9 * field * std::sqrt(unit(rng));
+        double phi = 2.0 * M_PI * unit(rng);
+        body.push_back({-1, std::sin(angle) * std::cos(phi), std::sin(angle) * std::sin(phi), std::cos(angle), 4.0});
+    }
+    return body;
+}
+
+// 20 views of each case must be solved with every match carrying the ID of
+// its star (so no false star is identified) and the attitude within 1e-3 rad;
+// 2 arcsec of noise per star leaves tens of arcsec of roll error in a 5
+// degree field
+static bool solve_views(const SolverDatabase& db, const SolverOptions& options, const std::vector<ViewCase>& cases,
+                        std::mt19937& rng) {
+    const double field = 0.5 * MAX_FOV_RAD;
+    for (const ViewCase& view : cases) {
+        int views = 0, solved = 0;
+        double max_error = 0.0;
+        while (views < 20) {
+            Quaternion truth = random_attitude(rng);
+            std::vector<Star> body = make_view(db, truth, field, view, rng);
+            if (body.empty()) continue;
+            ++views;
+
+            SolveResult result = solve_stars(body, db, options);
+            if (!result.solved) continue;
+            bool identified = true;
+            for (const Observation& m : result.matches) {
+                identified &= m.body.id == m.inertial.id;
+            }
+            if (!identified) continue;
+            ++solved;
+            const Quaternion& q = result.attitude;
+            double dot = std::abs(q.w * truth.w + q.x * truth.x + q.y * truth.y + q.z * truth.z);
+            max_error = std::max(max_error, 2.0 * std::acos(std::min(1.0, dot)));
+        }
+
+        bool pass = solved == views && max_error < 1e-3;
+        std::cout << (pass ? "  PASS: " : "  FAIL: ") << view.name << ": " << solved << "/" << views
+                  << " views identified, max error " << max_error * 180.0 * 3600.0 / M_PI << " arcsec." << std::endl;
+        if (!pass) return false;
+    }
+    return true;
+}
+
+// ENGINE_PATTERNS must identify known views: dense ones, sparse ones that
+// only show the brightest six stars of a crowded field (as a frame near its
+// detection limit does), and dense ones with three bright false stars. The
+// permutation search must reject the mirror image of a pattern.
+static bool test_pattern_solve(const std::vector<Star>& catalog, std::mt19937& rng) {
+    std::cout << "\n[TEST] Pattern Engine Attitude Recovery..." << std::endl;
+    SolverDatabase db = prepare_solver(catalog, std::vector<Triangle>());
+    build_solver_patterns(db);
+    SolverOptions options;
+    options.engine = ENGINE_PATTERNS;
+
+    const Quaternion truth = random_attitude(rng);
+    const Star inertial[4] = {catalog[0], catalog[1], catalog[2], catalog[3]};
+    Star observed[4], mirrored[4];
+    for (int m = 0; m < 4; ++m) {
+        observed[m] = rotate_to_body(truth, inertial[m]);
+        mirrored[m] = {0, -observed[m].x, observed[m].y, observed[m].z, 0.0};
+    }
+    int order[4];
+    bool direct = correspond_pattern(observed, inertial, options.match_tolerance, order) &&
+                  order[0] == 0 && order[1] == 1 && order[2] == 2 && order[3] == 3;
+    if (!direct || correspond_pattern(mirrored, inertial, options.match_tolerance, order)) {
+        std::cout << "  FAIL: Permutation search " << (direct ? "accepted a mirrored" : "misassigned a")
+                  << " pattern." << std::endl;
+        return false;
+    }
+
+    return solve_views(db, options, {{"dense", 8, 0, 0}, {"sparse", 10, 6, 0}, {"false stars", 8, 0, 3}}, rng);
+}
+
+// The default triangle engine on the same kinds of views; its threshold of
+// five stars is one lower, so sparse views show five
+static bool test_triangle_solve(const SolverDatabase& db, std::mt19937& rng) {
+    std::cout << "\n[TEST] Triangle Engine Attitude Recovery..." << std::endl;
+    return solve_views(db, SolverOptions(), {{"dense", 8, 0, 0}, {"sparse", 10, 5, 0}, {"false stars", 8, 0, 3}}, rng);
+}
+
+// width x height sensor behind a 50 mm lens with 14 um pixels (8.2 degrees
+// across 512 pixels), principal point at the center, radial distortion k1
+static CameraModel test_camera(long width, long height, double k1) {
+    CameraModel camera;
+    camera.width = width;
+    camera.height = height;
+    camera.focal_length = 50.0;
+    camera.pixel_pitch = 0.014;
+    camera.cx = 0.5 * width;
+    camera.cy = 0.5 * height;
+    camera.k1 = k1;
+    build_camera_lut(camera);
+    return camera;
+}
+
+// With distortion on, the LUT must agree with pixel_to_vector_exact over the
+// whole sensor (corners, edges and the last pixel past a whole LUT step
+// included) and vector_to_pixel must invert it. A saved camera must load
+// back unchanged, and files whose LUT does not match the image size must be
+// rejected without touching the camera they were loaded into.
+static bool test_camera_model(std::mt19937& rng) {
+    std::cout << "\n[TEST] Camera Model..." << std::endl;
+    CameraModel camera = test_camera(1001, 747, -0.05);
+    camera.k2 = 0.01;
+    camera.p1 = 2e-4;
+    camera.p2 = -1e-4;
+    build_camera_lut(camera);
+    const double pixel_angle = camera.pixel_pitch / camera.focal_length;
+
+    std::vector<std::pair<double, double>> points;
+    const double w = camera.width - 1, h = camera.height - 1;
+    for (double x : {0.0, 0.5, 0.5 * w, w - 0.5, w}) {
+        for (double y : {0.0, 0.5, 0.5 * h, h - 0.5, h}) {
+            points.push_back({x, y});
+        }
+    }
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int i = 0; i < 2000; ++i) {
+        points.push_back({unit(rng) * w, unit(rng) * h});
+    }
+
+    double lut_error = 0.0, round_trip = 0.0;
+    for (const auto& p : points) {
+        Star exact = pixel_to_vector_exact(camera, p.first, p.second);
+        Star table = pixel_to_vector(camera, p.first, p.second);
+        double dot = exact.x * table.x + exact.y * table.y + exact.z * table.z;
+        lut_error = std::max(lut_error, std::acos(std::min(1.0, dot)));
+
+        double x, y;
+        if (!vector_to_pixel(camera, exact, x, y)) {
+            round_trip = INFINITY;
+            break;
+        }
+        round_trip = std::max(round_trip, std::max(std::abs(x - p.first), std::abs(y - p.second)));
+    }
+    if (lut_error > 0.001 * pixel_angle || round_trip > 1e-6) {
+        std::cout << "  FAIL: LUT off by " << lut_error / pixel_angle << " px, vector_to_pixel off by "
+                  << round_trip << " px." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: LUT within " << lut_error / pixel_angle << " px of the exact model at " << points.size()
+              << " points, vector_to_pixel inverts it to " << round_trip << " px." << std::endl;
+
+    const std::string filename = (std::filesystem::temp_directory_path() / "startracker_camera_test.cal").string();
+    CameraModel loaded;
+    bool same = save_camera(filename, camera) && load_camera(filename, loaded) &&
+                loaded.width == camera.width && loaded.height == camera.height &&
+                loaded.focal_length == camera.focal_length && loaded.pixel_pitch == camera.pixel_pitch &&
+                loaded.cx == camera.cx && loaded.cy == camera.cy && loaded.k1 == camera.k1 && loaded.k2 == camera.k2 &&
+                loaded.k3 == camera.k3 && loaded.p1 == camera.p1 && loaded.p2 == camera.p2 &&
+                loaded.lut_step == camera.lut_step && loaded.lut_cols == camera.lut_cols &&
+                loaded.lut_rows == camera.lut_rows && loaded.lut == camera.lut;
+
+    // a LUT built for another image size, and one cut short
+    CameraModel resized = camera;
+    resized.width += camera.lut_step;
+    CameraModel short_lut = camera;
+    short_lut.lut.resize(short_lut.lut.size() - 3 * short_lut.lut_cols);
+    int accepted = 0;
+    for (const CameraModel* bad : {&resized, &short_lut}) {
+        CameraModel target = loaded;
+        if (!save_camera(filename, *bad)) {
+            accepted++;
+            continue;
+        }
+        accepted += load_camera(filename, target) || target.width != loaded.width || target.lut != loaded.lut;
+    }
+    std::error_code error;
+    std::filesystem::remove(filename, error);
+
+    if (!same || accepted) {
+        std::cout << "  FAIL: " << (same ? "" : "saved camera does not load back unchanged; ")
+                  << accepted << " mismatched LUT file(s) accepted." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: saved camera loads back unchanged; mismatched LUT files are rejected." << std::endl;
+    return true;
+}
+
+static double attitude_error(const Quaternion& q, const Quaternion& truth) {
+    double dot = std::abs(q.w * truth.w + q.x * truth.x + q.y * truth.y + q.z * truth.z);
+    return 2.0 * std::acos(std::min(1.0, dot));
+}
+
+// measure_rate must invert propagate_attitude. track_frame must follow a
+// rendered 1 deg/s slew by association once its first frame is solved
+// lost-in-space, and fall back to a lost-in-space solve from a prior that
+// is five degrees off.
+static bool test_tracking(const SolverDatabase& db, std::mt19937& rng) {
+    std::cout << "\n[TEST] Attitude Tracking..." << std::endl;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    double worst_rate = 0.0;
+    for (int i = 0; i < 100; ++i) {
+        Quaternion q = random_attitude(rng);
+        Star axis = random_star(0, rng);
+        double speed = 0.001 + 2.0 * unit(rng);
+        double dt = 0.01 + unit(rng);
+        const double rate[3] = {axis.x * speed, axis.y * speed, axis.z * speed};
+        double measured[3];
+        measure_rate(q, propagate_attitude(q, rate, dt), dt, measured);
+        for (int k = 0; k < 3; ++k) {
+            worst_rate = std::max(worst_rate, std::abs(measured[k] - rate[k]));
+        }
+    }
+    if (worst_rate > 1e-9) {
+        std::cout << "  FAIL: measure_rate is off from the propagated rate by " << worst_rate << " rad/s." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: measure_rate recovers the propagated rate to " << worst_rate << " rad/s." << std::endl;
+
+    CameraModel camera = test_camera(512, 512, 0.0);
+    // a dozen stars in the field leave a pixel or two of roll about the boresight
+    const double max_error = 3.0 * camera.pixel_pitch / camera.focal_length;
+    DetectionWorkspace workspace;
+    ImageData data;
+    auto observe = [&](const Quaternion& truth) {
+        RenderOptions render;
+        render.seed = rng();
+        RenderedFrame rendered = render_frame(db.stars, db.sky, truth, camera, render);
+        detect_frame(rendered.frame, DetectionOptions(), workspace, data);
+        return clusters_to_stars(camera, data.clusters);
+    };
+
+    const size_t frames = 40;
+    const double frame_rate = 20.0;
+    const double speed = M_PI / 180.0;
+    Star axis = random_star(0, rng);
+    const double rate[3] = {axis.x * speed, axis.y * speed, axis.z * speed};
+    const Quaternion start = random_attitude(rng);
+    TrackingState state;
+    size_t tracked = 0, fell_back = 0, solved = 0;
+    double worst = 0.0;
+    for (size_t f = 0; f < frames; ++f) {
+        double t = f / frame_rate;
+        Quaternion truth = propagate_attitude(start, rate, t);
+        TrackResult result = track_frame(observe(truth), t, state, db);
+        tracked += result.tracked;
+        fell_back += result.fell_back;
+        if (result.solve.solved) {
+            solved++;
+            worst = std::max(worst, attitude_error(result.solve.attitude, truth));
+        }
+    }
+    if (solved != frames || tracked == 0 || tracked + fell_back != frames || worst > max_error) {
+        std::cout << "  FAIL: slew: " << solved << "/" << frames << " solved, " << tracked << " tracked, "
+                  << fell_back << " lost-in-space, max error " << worst * 180.0 * 3600.0 / M_PI << " arcsec." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: slew: " << tracked << "/" << frames << " frames tracked, max error "
+              << worst * 180.0 * 3600.0 / M_PI << " arcsec." << std::endl;
+
+    // a prior five degrees off associates nothing, so the frame is solved lost-in-space
+    Quaternion truth = random_attitude(rng);
+    Star off_axis = random_star(0, rng);
+    const double off[3] = {off_axis.x, off_axis.y, off_axis.z};
+    TrackingState wrong;
+    wrong.valid = true;
+    wrong.attitude = propagate_attitude(truth, off, 5.0 * M_PI / 180.0);
+    wrong.timestamp = 1.0;
+    TrackResult result = track_frame(observe(truth), 1.0, wrong, db);
+    double error = attitude_error(wrong.attitude, truth);
+    if (result.tracked || !result.fell_back || !result.solve.solved || error > max_error) {
+        std::cout << "  FAIL: wrong prior: " << (result.tracked ? "tracked" : "not tracked") << ", "
+                  << (result.fell_back ? "fell back" : "no fallback") << ", state off by "
+                  << error * 180.0 * 3600.0 / M_PI << " arcsec." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: wrong prior: fell back and recovered to " << error * 180.0 * 3600.0 / M_PI
+              << " arcsec." << std::endl;
+    return true;
+}
+
+// Five heads on two workers with short queues, each head fed from its own
+// thread with frames of assorted sizes (so solves take uneven time). Every
+// frame must be delivered exactly once, per head in submission order, with
+// the timestamp it was submitted with and no overlapping calls for one head.
+static bool test_camera_pool(const std::shared_ptr<const SolverContext>& context, std::mt19937& rng) {
+    std::cout << "\n[TEST] Camera Pool Ordering..." << std::endl;
+    const int heads = 5;
+    const size_t frames_per_head = 30;
+
+    std::vector<std::vector<FrameBuffer>> frames(heads);
+    std::uniform_int_distribution<long> size(16, 320);
+    std::normal_distribution<double> noise(1000.0, 20.0);
+    for (int h = 0; h < heads; ++h) {
+        for (size_t f = 0; f < frames_per_head; ++f) {
+            FrameBuffer frame;
+            frame.width = size(rng);
+            frame.height = size(rng);
+            frame.pixel_type = USHORT_IMG;
+            frame.pixels.resize(frame.width * frame.height * sizeof(uint16_t));
+            uint16_t* pixels = reinterpret_cast<uint16_t*>(frame.pixels.data());
+            for (long i = 0; i < frame.width * frame.height; ++i) {
+                pixels[i] = static_cast<uint16_t>(std::max(0.0, noise(rng)));
+            }
+            frame.timestamp = 1000.0 * h + f;
+            frames[h].push_back(std::move(frame));
+        }
+    }
+
+    CameraPoolOptions options;
+    options.threads = 2;
+    options.queue_capacity = 2;
+    options.solver.max_stars = 6; // noise frames never solve; keep their searches short
+    std::mutex mutex;
+    std::vector<uint64_t> next(heads, 0);
+    std::vector<std::atomic<int>> active(heads);
+    size_t delivered = 0, wrong = 0;
+    std::atomic<int> overlapping(0);
+    CameraPool pool(context, std::vector<CameraModel>(heads, test_camera(512, 512, 0.0)), options,
+                    [&](const CameraResult& result) {
+        if (result.camera < 0 || result.camera >= heads) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wrong++;
+            return;
+        }
+        overlapping += active[result.camera].fetch_add(1) != 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t expected = next[result.camera]++;
+            wrong += result.sequence != expected || result.timestamp != 1000.0 * result.camera + expected;
+            delivered++;
+        }
+        std::this_thread::yield();
+        active[result.camera].fetch_sub(1);
+    });
+
+    std::vector<std::thread> producers;
+    std::atomic<int> rejected(0);
+    for (int h = 0; h < heads; ++h) {
+        producers.emplace_back([&, h]() {
+            for (FrameBuffer& frame : frames[h]) {
+                rejected += !pool.submit(h, frame);
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    pool.drain();
+    size_t missing = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int h = 0; h < heads; ++h) {
+            missing += frames_per_head - std::min<uint64_t>(frames_per_head, next[h]);
+        }
+    }
+    pool.finish();
+    FrameBuffer late;
+    bool accepted_late = pool.submit(0, late);
+
+    if (wrong || missing || overlapping || rejected || delivered != heads * frames_per_head || accepted_late) {
+        std::cout << "  FAIL: " << delivered << " delivered, " << wrong << " out of order or mislabeled, "
+                  << missing << " missing, " << overlapping << " overlapping, " << rejected << " rejected"
+                  << (accepted_late ? ", accepted a frame after finish" : "") << "." << std::endl;
+        return false;
+    }
+    std::cout << "  PASS: " << delivered << " frames from " << heads << " heads delivered in order on "
+              << options.threads << " workers." << std::endl;
+    return true;
+}
+
+// Reference labeling: flood fill from each unlabeled pixel in raster order
+static int flood_labels(const std::vector<uint8_t>& mask, long width, long height, std::vector<int>& labels) {
+    labels.assign(width * height, 0);
+    std::vector<long> stack;
+    int n = 0;
+    for (long start = 0; start < width * height; ++start) {
+        if (!mask[start] || labels[start]) continue;
+        labels[start] = ++n;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            long i = stack.back();
+            stack.pop_back();
+            long x = i % width;
+            const long neighbours[4] = {x > 0 ? i - 1 : -1, x + 1 < width ? i + 1 : -1, i - width, i + width};
+            for (long j : neighbours) {
+                if (j >= 0 && j < width * height && mask[j] && !labels[j]) {
+                    labels[j] = n;
+                    stack.push_back(j);
+                }
+            }
+        }
+    }
+    return n;
+}
+
+// label_components must give the reference labels with 1, 2 and 7 threads,
+// on random masks from sparse to percolating, including frames with fewer
+// rows than threads and components that snake across every strip border
+static bool test_label_components(std::mt19937& rng) {
+    std::cout << "\n[TEST] Connected Components Across Threads..." << std::endl;
+    const long sizes[][2] = {{1, 1}, {17, 1}, {5, 3}, {64, 6}, {131, 97}, {300, 211}};
+    const double densities[] = {0.05, 0.3, 0.55, 0.7};
+    const int threads[] = {1, 2, 7};
+
+    std::vector<uint8_t> mask;
+    std::vector<int> expected, labels;
+    int masks = 0;
+    for (const auto& size : sizes) {
+        const long width = size[0];
+        const long height = size[1];
+        for (int shape = 0; shape <= 4; ++shape) {
+            mask.resize(width * height);
+            if (shape < 4) {
+                std::bernoulli_distribution on(densities[shape]);
+                for (auto& m : mask) m = on(rng);
+            } else {
+                // a serpentine: full rows joined alternately at the right and left ends
+                for (long y = 0; y < height; ++y) {
+                    for (long x = 0; x < width; ++x) {
+                        mask[y * width + x] = y % 2 == 0 || x == ((y / 2) % 2 == 0 ? width - 1 : 0);
+                    }
+                }
+            }
+            ++masks;
+
+            int n = flood_labels(mask, width, height, expected);
+            for (int t : threads) {
+                int count = label_components(mask, width, height, t, labels);
+                if (count != n || labels != expected) {
+                    std::cout << "  FAIL: " << t << " thread(s) mislabel a " << width << "x" << height
+                              << " mask (" << count << " components, expected " << n << ")." << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    std::cout << "  PASS: " << masks << " masks labeled identically with 1, 2 and 7 threads." << std::endl;
+    return true;
+}
+
+// A w x h frame of pixel type T: tilted background with Gaussian noise, spots
+// of assorted brightness and a few touching ones, a U that only joins at its
+// bottom, and a serpentine that zigzags down through several bands
+template <typename T>
+static FrameBuffer streaming_test_frame(long width, long height, int pixel_type, std::mt19937& rng) {
+    std::vector<double> image(width * height);
+    std::normal_distribution<double> noise(0.0, 8.0);
+    for (long y = 0; y < height; ++y) {
+        for (long x = 0; x < width; ++x) {
+            image[y * width + x] = 900.0 + 0.6 * x + 0.3 * y + noise(rng);
+        }
+    }
+
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    auto spot = [&](double cx, double cy, double peak, double sigma) {
+        for (long y = std::max(0L, (long)(cy - 4 * sigma)); y <= std::min(height - 1, (long)(cy + 4 * sigma)); ++y) {
+            for (long x = std::max(0L, (long)(cx - 4 * sigma)); x <= std::min(width - 1, (long)(cx + 4 * sigma)); ++x) {
+                image[y * width + x] += peak * std::exp(-((x - cx) * (x - cx) + (y - cy) * (y - cy)) / (2 * sigma * sigma));
+            }
+        }
+    };
+    for (int i = 0; i < 90; ++i) {
+        spot(u(rng) * width, u(rng) * height, 100.0 + 3000.0 * u(rng), 0.8 + 1.5 * u(rng));
+    }
+    // pairs close enough to run together
+    for (int i = 0; i < 6; ++i) {
+        double cx = u(rng) * width, cy = u(rng) * height;
+        spot(cx, cy, 2000.0, 1.2);
+        spot(cx + 3.0, cy + 2.0, 1500.0, 1.2);
+    }
+
+    const long ux = width / 3, uy = height / 2;
+    for (long y = uy; y < uy + 20 && y < height; ++y) {
+        image[y * width + ux] += 2500.0;
+        image[y * width + ux + 12] += 2500.0;
+    }
+    for (long x = ux; x <= ux + 12; ++x) {
+        image[std::min(height - 1, uy + 20) * width + x] += 2500.0;
+    }
+    for (long y = 5; y < height - 5; ++y) {
+        long x = width - 30 + ((y / 9) % 2 == 0 ? (y % 9) : 8 - (y % 9));
+        image[y * width + x] += 2500.0;
+    }
+
+    FrameBuffer frame;
+    frame.width = width;
+    frame.height = height;
+    frame.pixel_type = pixel_type;
+    frame.pixels.resize(width * height * sizeof(T));
+    T* out = reinterpret_cast<T*>(frame.pixels.data());
+    for (long i = 0; i < width * height; ++i) {
+        out[i] = static_cast<T>(std::max(0.0, std::round(image[i])));
+    }
+    return frame;
+}
+
+static bool test_streaming_detection(std::mt19937& rng) {
+    std::cout << "\n[TEST] Streaming Detection Matches Full-Frame Detection..." << std::endl;
+    const std::string filename = (std::filesystem::temp_directory_path() / "startracker_streaming_test.fits").string();
+
+    struct Case {
+        const char* name;
+        FrameBuffer frame;
+    };
+    std::vector<Case> frames = {{"16-bit", streaming_test_frame<uint16_t>(331, 257, USHORT_IMG, rng)},
+                                {"float", streaming_test_frame<float>(200, 150, FLOAT_IMG, rng)}};
+
+    std::vector<DetectionOptions> configs(4);
+    configs[1].local_background = true;
+    configs[2].max_clusters = 10;
+    configs[3].local_background = true;
+    configs[3].tile_size = 48;
+    configs[3].max_clusters = 10;
+    const long band_rows[] = {1, 7, 64, 1000};
+
+    int compared = 0;
+    bool ok = true;
+    for (const Case& c : frames) {
+        if (!fits_write_frame(filename, c.frame)) {
+            std::cout << "  FAIL: cannot write " << filename << "." << std::endl;
+            return false;
+        }
+        for (size_t k = 0; k < configs.size() && ok; ++k) {
+            const DetectionOptions& options = configs[k];
+            ImageData full = fits_to_data(filename, options);
+            for (long rows : band_rows) {
+                ImageData streamed = fits_to_data_streaming(filename, options, rows);
+                const char* what = nullptr;
+                if (streamed.width != full.width || streamed.height != full.height ||
+                    streamed.intensity_mean != full.intensity_mean ||
+                    streamed.intensity_standard_deviation != full.intensity_standard_deviation ||
+                    streamed.intensity_threshold != full.intensity_threshold) {
+                    what = "statistics differ";
+                } else if (full.clusters.size() < std::min<size_t>(options.max_clusters, 20) ||
+                           streamed.clusters.size() != full.clusters.size()) {
+                    what = "cluster count differs";
+                }
+                for (size_t i = 0; what == nullptr && i < full.clusters.size(); ++i) {
+                    const Cluster& a = full.clusters[i];
+                    const Cluster& b = streamed.clusters[i];
+                    if (a.id != b.id || a.pixel_count != b.pixel_count || a.x_min != b.x_min || a.y_min != b.y_min ||
+                        a.x_max != b.x_max || a.y_max != b.y_max) {
+                        what = "cluster ids or extents differ";
+                    } else if (std::abs(a.x_centroid - b.x_centroid) > 1e-9 || std::abs(a.y_centroid - b.y_centroid) > 1e-9 ||
+                               std::abs(a.total_intensity - b.total_intensity) > 1e-9 * a.total_intensity) {
+                        what = "centroids or intensities differ";
+                    }
+                }
+                if (what) {
+                    std::cout << "  FAIL: " << c.name << " frame, options " << k << ", " << rows
+                              << " row bands: " << what << "." << std::endl;
+                    ok = false;
+                    break;
+                }
+                ++compared;
+            }
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove(filename, error);
+    if (ok) {
+        std::cout << "  PASS: " << compared << " streamed detections match fits_to_data." << std::endl;
+    }
+    return ok;
+}
+
+static std::atomic<bool> stop_requested(false);
+
+static void print_pipeline_result(const PipelineResult& result) {
+    std::cout << result.sequence << " " << std::fixed << result.timestamp << std::defaultfloat
+              << " " << result.filename << "[" << result.plane << "] "
+              << (result.solve.solved ? "solved" : "no solution")
+              << " q=[" << result.solve.attitude.w << ", " << result.solve.attitude.x << ", "
+              << result.solve.attitude.y << ", " << result.solve.attitude.z << "]"
+              << " stars=" << result.solve.verified_count << "/" << result.solve.star_count
+              << " latency=" << result.solve.timings.total_ms << "ms" << std::endl;
+}
+
+// STARTRACKER_METRICS=json (or prometheus) dumps the counters and stage
+// histograms to stderr when a command finishes
+static void dump_metrics() {
+    const char* format = std::getenv("STARTRACKER_METRICS");
+    if (format == nullptr) return;
+    if (std::string(format) == "prometheus") {
+        std::cerr << metrics_to_prometheus(metrics_snapshot());
+    } else {
+        std::cerr << metrics_to_json(metrics_snapshot());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // A trailing --patterns makes the solving commands identify with the
+    // 4-star pattern hash instead of the triangle table
+    const bool use_patterns = argc > 2 && std::string(argv[argc - 1]) == "--patterns";
+    if (use_patterns) {
+        argc--;
+    }
+    SolverOptions solver_options;
+    solver_options.engine = use_patterns ? ENGINE_PATTERNS : ENGINE_TRIANGLES;
+
+    // Builder step: ./app build-db <catalog.csv> <output.db>
+    if (argc == 4 && std::string(argv[1]) == "build-db") {
+        std::vector<Star> catalog = csv_to_catalog(argv[2]);
+        std::vector<Triangle> triangles = catalog_to_triangles(catalog);
+        if (!write_database(argv[3], catalog, triangles)) {
+            return 1;
+        }
+        std::cout << "Wrote " << catalog.size() << " stars and " << triangles.size() << " triangles to " << argv[3] << std::endl;
+        return 0;
+    }
+
+    // Lost-in-space solve: ./app solve <database.db> <camera.cal> <frame.fits>...
+    if (argc >= 5 && std::string(argv[1]) == "solve") {
+        TriangleDatabase db = open_database(argv[2]);
+        CameraModel camera;
+        if (db.stars == nullptr || !load_camera(argv[3], camera)) {
+            close_database(db);
+            return 1;
+        }
+
+        SolverDatabase solver_db = prepare_solver(db);
+        if (use_patterns) {
+            build_solver_patterns(solver_db);
+        }
+        for (int i = 4; i < argc; ++i) {
+            SolveResult result = solve_frame(argv[i], camera, solver_db, solver_options);
+            std::cout << argv[i] << ": " << (result.solved ? "solved" : "no solution")
+                      << " q=[" << result.attitude.w << ", " << result.attitude.x << ", " << result.attitude.y << ", " << result.attitude.z << "]"
+                      << " stars=" << result.verified_count << "/" << result.star_count
+                      << " triples=" << result.triples_tried
+                      << " detect=" << result.timings.detect_ms << "ms"
+                      << " identify=" << result.timings.identify_ms << "ms"
+                      << " verify=" << result.timings.verify_ms << "ms"
+                      << " total=" << result.timings.total_ms << "ms" << std::endl;
+        }
+
+        dump_metrics();
+        close_database(db);
+        return 0;
+    }
+
+    // Sequence mode: ./app sequence <database.db> <camera.cal> <frames or cubes>...
+    //            or ./app watch <database.db> <camera.cal> <directory>   (Ctrl-C to stop)
+    if (argc >= 5 && (std::string(argv[1]) == "sequence" || std::string(argv[1]) == "watch")) {
+        TriangleDatabase db = open_database(argv[2]);
+        CameraModel camera;
+        if (db.stars == nullptr || !load_camera(argv[3], camera)) {
+            close_database(db);
+            return 1;
+        }
+
+        SolverDatabase solver_db = prepare_solver(db);
+        if (use_patterns) {
+            build_solver_patterns(solver_db);
+        }
+        PipelineOptions options;
+        options.solver = solver_options;
+        size_t frames = 0;
+        if (std::string(argv[1]) == "sequence") {
+            std::vector<std::string> files(argv + 4, argv + argc);
+            frames = run_pipeline(files, camera, solver_db, options, print_pipeline_result);
+        } else {
+            std::signal(SIGINT, [](int) { stop_requested.store(true); });
+            frames = watch_directory(argv[4], camera, solver_db, options, stop_requested, print_pipeline_result);
+        }
+        std::cout << "Processed " << frames << " frames" << std::endl;
+
+        dump_metrics();
+        close_database(db);
+        return 0;
+    }
+
+    // Synthetic end-to-end sweep: ./app sweep <database.db> <camera.cal> [frames per cell] [fits directory]
+    // Renders frames from the database catalog, solves them and prints JSON statistics.
+    if (argc >= 4 && argc <= 6 && std::string(argv[1]) == "sweep") {
+        TriangleDatabase db = open_database(argv[2]);
+        CameraModel camera;
+        if (db.stars == nullptr || !load_camera(argv[3], camera)) {
+            close_database(db);
+            return 1;
+        }
+
+        SolverDatabase solver_db = prepare_solver(db);
+        if (use_patterns) {
+            build_solver_patterns(solver_db);
+        }
+        SweepOptions options;
+        options.solver = solver_options;
+        if (argc >= 5) {
+            options.frames_per_cell = std::stoul(argv[4]);
+        }
+        if (argc >= 6) {
+            options.fits_directory = argv[5];
+        }
+        std::vector<SweepCell> cells = run_sweep(solver_db, camera, options);
+        if (cells.empty()) {
+            close_database(db);
+            return 1;
+        }
+        std::cout << sweep_to_json(cells);
+
+        dump_metrics();
+        close_database(db);
+        return 0;
+    }
+
+    // Multi-camera throughput: ./app cameras <database.db> <camera.cal> [heads] [frames per head] [threads]
+    // Renders frames for every head, feeds them to one shared camera pool from
+    // one thread per head and reports the frame rate.
+    if (argc >= 4 && argc <= 7 && std::string(argv[1]) == "cameras") {
+        std::shared_ptr<const SolverContext> context = open_solver_context(argv[2], use_patterns);
+        CameraModel camera;
+        if (context == nullptr || !load_camera(argv[3], camera)) {
+            return 1;
+        }
+        const int heads = argc >= 5 ? std::stoi(argv[4]) : 4;
+        const size_t frames_per_head = argc >= 6 ? std::stoul(argv[5]) : 50;
+        CameraPoolOptions options;
+        options.solver = solver_options;
+        options.threads = argc >= 7 ? std::stoi(argv[6]) : 0;
+
+        std::mt19937 rng(1);
+        std::vector<std::vector<FrameBuffer>> frames(heads);
+        for (auto& head_frames : frames) {
+            for (size_t f = 0; f < frames_per_head; ++f) {
+                Quaternion q = random_attitude(rng);
+                RenderOptions render;
+                render.seed = rng();
+                head_frames.push_back(render_frame(context->db.stars, context->db.sky, q, camera, render).frame);
+            }
+        }
+
+        std::mutex mutex;
+        size_t solved = 0, delivered = 0, out_of_order = 0;
+        std::vector<uint64_t> next(heads, 0);
+        CameraPool pool(context, std::vector<CameraModel>(heads, camera), options, [&](const CameraResult& result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            out_of_order += result.sequence != next[result.camera]++;
+            solved += result.solve.solved;
+            delivered++;
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> producers;
+        for (int h = 0; h < heads; ++h) {
+            producers.emplace_back([&, h]() {
+                for (FrameBuffer& frame : frames[h]) {
+                    pool.submit(h, frame);
+                }
+            });
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+        pool.drain();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << heads << " heads, " << delivered << " frames, " << solved << " solved, "
+                  << out_of_order << " out of order, " << delivered / seconds << " frames/s" << std::endl;
+
+        pool.finish();
+        dump_metrics();
+        return out_of_order > 0 || delivered != heads * frames_per_head ? 1 : 0;
+    }
+
+    // Tracking: ./app track <database.db> <camera.cal> [frames] [rate deg/s] [frame rate Hz]
+    // Renders a slew at a constant body rate and follows it with track_frame,
+    // which starts lost-in-space and then identifies by association.
+    if (argc >= 4 && argc <= 7 && std::string(argv[1]) == "track") {
+        std::shared_ptr<const SolverContext> context = open_solver_context(argv[2], use_patterns);
+        CameraModel camera;
+        if (context == nullptr || !load_camera(argv[3], camera)) {
+            return 1;
+        }
+        const size_t frames = argc >= 5 ? std::stoul(argv[4]) : 100;
+        const double speed = (argc >= 6 ? std::stod(argv[5]) : 1.0) * M_PI / 180.0;
+        const double frame_rate = argc >= 7 ? std::stod(argv[6]) : 20.0;
+
+        std::mt19937 rng(1);
+        Star axis = random_star(0, rng);
+        const double rate[3] = {axis.x * speed, axis.y * speed, axis.z * speed};
+        const Quaternion start = random_attitude(rng);
+
+        TrackingOptions tracking;
+        tracking.solver = solver_options;
+        TrackingState state;
+        DetectionWorkspace workspace;
+        ImageData data;
+        size_t tracked = 0, fell_back = 0, solved = 0;
+        double track_us = 0.0, max_track_us = 0.0, lost_ms = 0.0, max_error = 0.0;
+        for (size_t f = 0; f < frames; ++f) {
+            double t = f / frame_rate;
+            Quaternion truth = propagate_attitude(start, rate, t);
+            RenderOptions render;
+            render.seed = rng();
+            RenderedFrame rendered = render_frame(context->db.stars, context->db.sky, truth, camera, render);
+
+            detect_frame(rendered.frame, SolverOptions().detection, workspace, data);
+            std::vector<Star> body = clusters_to_stars(camera, data.clusters);
+            TrackResult result = track_frame(body, t, state, context->db, tracking);
+
+            if (result.tracked) {
+                tracked++;
+                track_us += result.track_us;
+                max_track_us = std::max(max_track_us, result.track_us);
+            }
+            if (result.fell_back) {
+                fell_back++;
+                lost_ms += result.solve.timings.total_ms;
+            }
+            if (result.solve.solved) {
+                solved++;
+                const Quaternion& q = result.solve.attitude;
+                double dot = std::abs(q.w * truth.w + q.x * truth.x + q.y * truth.y + q.z * truth.z);
+                max_error = std::max(max_error, 2.0 * std::acos(std::min(1.0, dot)) * 180.0 * 3600.0 / M_PI);
+            }
+        }
+
+        std::cout << frames << " frames, " << solved << " solved, " << tracked << " tracked ("
+                  << (tracked ? track_us / tracked : 0.0) << " us mean, " << max_track_us << " us max), "
+                  << fell_back << " lost-in-space (" << (fell_back ? lost_ms / fell_back : 0.0) << " ms mean), "
+                  << "max error " << max_error << " arcsec" << std::endl;
+
+        dump_metrics();
+        return 0;
+    }
+
+    // TriangleDatabase db = open_database("data/hipparcos.db");
+    // Triangle match = find_triangle(s1, s2, s3, db.triangles, db.triangle_count);
+
     // std::string m42_filename = "data/m42_40min_red.fits";
     // ImageData m42 = fits_to_data(m42_filename);
     // std::cout << "Loaded " << m42.clusters.size() << " clusters from " << m42_filename << std::endl;
@@ -198,6 +1309,8 @@ int main() {
     //     return -1;
     // }
 
+    // SkyIndex sky = build_sky_index(catalog, MAX_FOV_RAD);
+
     // int passed = 0;
     // int failed = 0;
     // int total_tests = 0;
@@ -210,17 +1323,9 @@ int main() {
 
     //     // 1. Reconstruct the 3 stars from the IDs
     //     // (In a real scenario, we don't know the IDs yet, just the positions)
-    //     Star s1, s2, s3;
-        
-    //     // Simple linear search to find the stars by ID
-    //     // (Optimization: A hash map would be faster, but this is fine for testing)
-    //     int found_count = 0;
-    //     for(const auto& s : catalog) {
-    //         if (s.id == expected.star1) { s1 = s; found_count++; }
-    //         else if (s.id == expected.star2) { s2 = s; found_count++; }
-    //         else if (s.id == expected.star3) { s3 = s; found_count++; }
-    //         if (found_count == 3) break;
-    //     }
+    //     Star s1 = catalog[find_star_id(sky, expected.star1)];
+    //     Star s2 = catalog[find_star_id(sky, expected.star2)];
+    //     Star s3 = catalog[find_star_id(sky, expected.star3)];
 
     //     // 2. Run the Matcher
     //     // We pass the 3 star objects. The matcher measures them and searches the DB.
@@ -270,5 +1375,22 @@ int main() {
 
     test_triad_solver();
 
-    return 0;
+    std::mt19937 test_rng(42);
+    bool passed = test_scan_kernels(test_rng);
+    passed &= test_label_components(test_rng);
+    passed &= test_streaming_detection(test_rng);
+    passed &= test_camera_model(test_rng);
+    std::vector<Star> random_catalog = build_random_catalog(2000, 0.01, test_rng);
+    passed &= test_pattern_table(random_catalog);
+    // about as many stars as a magnitude 6.5 catalog, so a field holds more
+    // stars than a frame near its detection limit shows
+    std::vector<Star> sky_catalog = build_random_catalog(8000, 0.004, test_rng);
+    passed &= test_sky_index(sky_catalog, test_rng);
+    passed &= test_pattern_solve(sky_catalog, test_rng);
+    std::shared_ptr<const SolverContext> sky = make_solver_context(sky_catalog, catalog_to_triangles(sky_catalog));
+    passed &= test_triangle_solve(sky->db, test_rng);
+    passed &= test_tracking(sky->db, test_rng);
+    passed &= test_camera_pool(sky, test_rng);
+
+    return passed ? 0 : 1;
 } 
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+#include "pattern.h"
+
+// 12 bits per quantized ratio
+#define PATTERN_KEY_BITS 12
+
+static double angle_between(const Star& s1, const Star& s2) {
+    double dot = s1.x * s2.x + s1.y * s2.y + s1.z * s2.z;
+    return std::acos(std::clamp(dot, -1.0, 1.0));
+}
+
+void pattern_edges(const Star stars[4], double edges[6]) {
+    int e = 0;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i + 1; j < 4; ++j) {
+            edges[e++] = angle_between(stars[i], stars[j]);
+        }
+    }
+    std::sort(edges, edges + 6);
+}
+
+static uint64_t pack_key(const long bins[5]) {
+    uint64_t key = 0;
+    for (int k = 0; k < 5; ++k) {
+        key |= static_cast<uint64_t>(bins[k]) << (PATTERN_KEY_BITS * k);
+    }
+    return key;
+}
+
+// Fibonacci hashing: the top bits of the product depend on every bit of the
+// key, so shapes that differ only in their largest ratios still spread out
+static size_t key_slot(uint64_t key, size_t mask) {
+    const int bits = __builtin_ctzll(static_cast<uint64_t>(mask) + 1);
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+static long ratio_bin(double ratio, double bin) {
+    long b = static_cast<long>(std::floor(ratio / bin));
+    return std::clamp(b, 0L, (1L << PATTERN_KEY_BITS) - 1);
+}
+
+PatternTable build_pattern_table(const Star* stars, size_t count, const SkyIndex& sky, const PatternOptions& options) {
+    PatternTable table;
+    table.options = options;
+    if (options.bin <= 0 || options.ratio_tolerance < 0 || options.ratio_tolerance > options.bin / 2 ||
+        options.stars_per_field < 4 || options.scales < 1 || options.radius <= 0) {
+        std::cerr << "Error: invalid pattern table options." << std::endl;
+        return table;
+    }
+    if (sky.star_index.size() != count) {
+        std::cerr << "Error: sky index is not built over the pattern catalog." << std::endl;
+        return table;
+    }
+
+    // every pattern as its sorted catalog positions; neighbouring fields
+    // share most of their stars, so duplicates are dropped after sorting
+    std::vector<std::array<uint32_t, 4>> patterns;
+    std::vector<uint32_t> cone;
+    const size_t cells = sky.cell_start.empty() ? 0 : sky.cell_start.size() - 1;
+    for (size_t cell = 0; cell < cells; ++cell) {
+        const double* center = &sky.cell_centers[cell * 3];
+        double radius = options.radius;
+        for (int scale = 0; scale < options.scales; ++scale, radius *= 2.0 / 3.0) {
+            cone.clear();
+            cone_query(sky, {0, center[0], center[1], center[2], 0.0}, radius, cone);
+
+            const size_t n = std::min(cone.size(), static_cast<size_t>(options.stars_per_field));
+            std::partial_sort(cone.begin(), cone.begin() + n, cone.end(), [&](uint32_t a, uint32_t b) {
+                return stars[a].magnitude < stars[b].magnitude || (stars[a].magnitude == stars[b].magnitude && a < b);
+            });
+
+            for (size_t a = 0; a < n; ++a) {
+                for (size_t b = a + 1; b < n; ++b) {
+                    for (size_t c = b + 1; c < n; ++c) {
+                        for (size_t d = c + 1; d < n; ++d) {
+                            std::array<uint32_t, 4> p = {cone[a], cone[b], cone[c], cone[d]};
+                            std::sort(p.begin(), p.end());
+                            patterns.push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::sort(patterns.begin(), patterns.end());
+    patterns.erase(std::unique(patterns.begin(), patterns.end()), patterns.end());
+
+    size_t size = 2;
+    while (size < 2 * patterns.size()) size *= 2;
+    table.entries.assign(size, PatternEntry{PATTERN_EMPTY, {0, 0, 0, 0}, 0.0f});
+    const size_t mask = size - 1;
+
+    for (const auto& p : patterns) {
+        const Star members[4] = {stars[p[0]], stars[p[1]], stars[p[2]], stars[p[3]]};
+        double edges[6];
+        pattern_edges(members, edges);
+        if (edges[5] <= 0) continue; // repeated positions
+
+        long bins[5];
+        for (int k = 0; k < 5; ++k) {
+            bins[k] = ratio_bin(edges[k] / edges[5], options.bin);
+        }
+        uint64_t key = pack_key(bins);
+
+        size_t slot = key_slot(key, mask);
+        while (table.entries[slot].key != PATTERN_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        table.entries[slot] = {key, {p[0], p[1], p[2], p[3]}, static_cast<float>(edges[5])};
+        table.count++;
+    }
+
+    return table;
+}
+
+void find_patterns(const PatternTable& table, const double edges[6], double max_edge_tolerance,
+                   std::vector<const PatternEntry*>& out) {
+    if (table.entries.empty() || edges[5] <= 0) return;
+    const double bin = table.options.bin;
+    const double tolerance = table.options.ratio_tolerance;
+    const size_t mask = table.entries.size() - 1;
+
+    // lowest bin and number of bins (1 or 2) each ratio can fall in
+    long low[5];
+    int span[5];
+    for (int k = 0; k < 5; ++k) {
+        double ratio = edges[k] / edges[5];
+        low[k] = ratio_bin(ratio - tolerance, bin);
+        span[k] = ratio_bin(ratio + tolerance, bin) > low[k] ? 2 : 1;
+    }
+
+    for (int combination = 0; combination < 32; ++combination) {
+        long bins[5];
+        bool valid = true;
+        for (int k = 0; k < 5; ++k) {
+            int step = (combination >> k) & 1;
+            if (step >= span[k]) {
+                valid = false;
+                break;
+            }
+            bins[k] = low[k] + step;
+        }
+        if (!valid) continue;
+
+        const uint64_t key = pack_key(bins);
+        for (size_t slot = key_slot(key, mask); table.entries[slot].key != PATTERN_EMPTY; slot = (slot + 1) & mask) {
+            const PatternEntry& entry = table.entries[slot];
+            if (entry.key == key && std::abs(entry.max_edge - edges[5]) <= max_edge_tolerance) {
+                out.push_back(&entry);
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "../catalog/catalog.h"
+#include "../triangle/triangle.h"
+#include "../sky/sky_index.h"
+
+// 4-star patterns keyed by their shape. The six pairwise angles of a pattern
+// are sorted and the five smaller ones divided by the largest; these ratios
+// do not change under rotation (or a focal length error), and quantized into
+// bins of width PatternOptions::bin they form the hash key.
+struct PatternOptions {
+    double radius = 0.75 * MAX_FOV_RAD; // largest field around each sky cell center
+    int scales = 2;                     // field sizes: radius, 2/3 radius, 4/9 radius, ...
+    int stars_per_field = 7;            // brightest stars of each field, combined in fours
+    double bin = 0.025;                 // ratio quantum of the key
+    double ratio_tolerance = 0.0125;    // lookups also probe neighbouring bins within this; at most bin / 2
+};
+
+// Catalog positions in ascending order, plus the largest pairwise angle
+struct PatternEntry {
+    uint64_t key;     // PATTERN_EMPTY for an unused slot
+    uint32_t stars[4];
+    float max_edge;   // rad
+};
+
+#define PATTERN_EMPTY UINT64_MAX
+
+// Open-addressing (linear probing) hash table of every pattern; each
+// pattern is stored once, under the bins of its exact ratios. Kept at most
+// half full.
+struct PatternTable {
+    PatternOptions options;
+    size_t count = 0;                  // patterns stored
+    std::vector<PatternEntry> entries; // power-of-two size
+};
+
+// Every cell of sky stands for fields of view centred on it, one per scale:
+// the `stars_per_field` brightest stars of each field are combined in fours,
+// which are the patterns a camera pointed there finds among its brightest
+// detections. A field much wider than the camera's would mostly pick stars
+// outside its frame, hence the smaller scales. The table grows with the
+// number of cells, not with the catalog. sky must be built over stars, with
+// cells well under the smallest field across (the default grid of
+// build_sky_index is a quarter of its max_radius).
+PatternTable build_pattern_table(const Star* stars, size_t count, const SkyIndex& sky,
+                                 const PatternOptions& options = PatternOptions());
+
+// Sorted pairwise angles of four unit vectors: edges[5] is the largest
+void pattern_edges(const Star stars[4], double edges[6]);
+
+// Appends the catalog patterns whose key matches the observed edges within
+// ratio_tolerance and whose largest angle is within max_edge_tolerance.
+// Each ratio touches at most two bins, so this probes at most 32 keys.
+void find_patterns(const PatternTable& table, const double edges[6], double max_edge_tolerance,
+                   std::vector<const PatternEntry*>& out);
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include "camera_pool.h"
+#include "pipeline.h"
+#include "../instrument/instrument.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct CameraJob {
+    FrameBuffer frame;
+    uint64_t sequence = 0;
+    Clock::time_point submitted;
+};
+
+// One camera head. pending counts frames pushed and not yet finished; the
+// head is in a run queue (or being worked on) exactly while pending > 0.
+struct CameraHead {
+    CameraModel camera;
+    BoundedQueue<CameraJob> frames;
+    std::atomic<uint64_t> next_sequence{0};
+    alignas(64) std::atomic<size_t> pending{0};
+
+    CameraHead(const CameraModel& model, size_t capacity) : camera(model), frames(capacity) {}
+};
+
+// Version counter plus a condition variable, as in the pipeline's stage
+// queues: the mutex is only taken when somebody is parked
+struct PoolEvent {
+    std::atomic<uint64_t> version{0};
+    std::atomic<int> parked{0};
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void notify() {
+        version.fetch_add(1);
+        if (parked.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            changed.notify_all();
+        }
+    }
+
+    void park(uint64_t seen) {
+        parked.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait_for(lock, std::chrono::milliseconds(10), [&]() { return version.load() != seen; });
+        }
+        parked.fetch_sub(1);
+    }
+};
+
+struct CameraPoolState {
+    std::shared_ptr<const SolverContext> context;
+    CameraPoolOptions options;
+    std::function<void(const CameraResult&)> on_result;
+
+    std::vector<std::unique_ptr<CameraHead>> heads;
+    // Per worker: heads with frames waiting. A head is in at most one run
+    // queue at a time, so a capacity of heads.size() is never exceeded.
+    std::vector<std::unique_ptr<BoundedQueue<int>>> run_queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> outstanding{0}; // submitted and not yet delivered
+    std::atomic<bool> closed{false};
+    std::atomic<bool> stop{false};
+
+    PoolEvent work;     // a head was scheduled, or stop
+    PoolEvent progress; // a frame left a camera queue or was delivered
+};
+
+static void schedule(CameraPoolState& state, size_t worker, int head) {
+    BoundedQueue<int>& queue = *state.run_queues[worker];
+    while (!queue.try_push(head)) {
+        std::this_thread::yield(); // cannot stay full, see run_queues
+    }
+    state.work.notify();
+}
+
+// Own run queue first, then the others starting from the next worker
+static bool take_head(CameraPoolState& state, size_t worker, int& head) {
+    const size_t n = state.run_queues.size();
+    for (size_t k = 0; k < n; ++k) {
+        if (state.run_queues[(worker + k) % n]->try_pop(head)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_worker(CameraPoolState& state, size_t worker) {
+    SolverScratch scratch;
+    CameraJob job;
+    int head = 0;
+
+    for (int spins = 0;; ++spins) {
+        uint64_t seen = state.work.version.load();
+        if (!take_head(state, worker, head)) {
+            if (state.stop.load()) break;
+            if (spins < 64) {
+                std::this_thread::yield();
+            } else {
+                state.work.park(seen);
+            }
+            continue;
+        }
+        spins = 0;
+
+        // one frame per turn; pending > 0 guarantees it was pushed, but with
+        // several producers it may still be in the middle of being written
+        CameraHead& h = *state.heads[head];
+        while (!h.frames.try_pop(job)) {
+            std::this_thread::yield();
+        }
+        state.progress.notify();
+
+        CameraResult result;
+        result.camera = head;
+        result.sequence = job.sequence;
+        result.timestamp = job.frame.timestamp;
+        result.solve = solve_frame(job.frame, h.camera, state.context->db, state.options.solver, scratch);
+        result.solve.timings.total_ms = elapsed_ms(job.submitted, Clock::now());
+        job.frame = FrameBuffer();
+        state.on_result(result);
+
+        if (h.pending.fetch_sub(1) > 1) {
+            schedule(state, worker, head);
+        }
+        state.outstanding.fetch_sub(1);
+        state.progress.notify();
+    }
+}
+
+CameraPool::CameraPool(std::shared_ptr<const SolverContext> context, const std::vector<CameraModel>& cameras,
+                       const CameraPoolOptions& options, std::function<void(const CameraResult&)> on_result)
+    : state(new CameraPoolState) {
+    state->context = std::move(context);
+    state->options = options;
+    state->on_result = std::move(on_result);
+
+    for (const CameraModel& camera : cameras) {
+        state->heads.emplace_back(new CameraHead(camera, std::max<size_t>(1, options.queue_capacity)));
+    }
+
+    int threads = options.threads;
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int t = 0; t < threads; ++t) {
+        state->run_queues.emplace_back(new BoundedQueue<int>(std::max<size_t>(2, cameras.size())));
+    }
+    for (int t = 0; t < threads; ++t) {
+        state->workers.emplace_back(run_worker, std::ref(*state), t);
+    }
+}
+
+CameraPool::~CameraPool() {
+    finish();
+}
+
+bool CameraPool::submit(int camera, FrameBuffer& frame) {
+    if (state->closed.load()) {
+        std::cerr << "Error: camera pool is finished." << std::endl;
+        return false;
+    }
+    if (camera < 0 || camera >= static_cast<int>(state->heads.size())) {
+        std::cerr << "Error: unknown camera " << camera << "." << std::endl;
+        return false;
+    }
+    CameraHead& h = *state->heads[camera];
+
+    CameraJob job;
+    job.frame = std::move(frame);
+    job.sequence = h.next_sequence.fetch_add(1);
+    job.submitted = Clock::now();
+
+    state->outstanding.fetch_add(1);
+    for (int spins = 0;; ++spins) {
+        uint64_t seen = state->progress.version.load();
+        if (h.frames.try_push(job)) break;
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            state->progress.park(seen);
+        }
+    }
+
+    if (h.pending.fetch_add(1) == 0) {
+        schedule(*state, camera % state->run_queues.size(), camera);
+    }
+    return true;
+}
+
+void CameraPool::drain() {
+    for (int spins = 0;; ++spins) {
+        uint64_t seen = state->progress.version.load();
+        if (state->outstanding.load() == 0) return;
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            state->progress.park(seen);
+        }
+    }
+}
+
+void CameraPool::finish() {
+    if (!state || state->stop.load()) return;
+    state->closed.store(true);
+    drain();
+
+    state->stop.store(true);
+    state->work.notify();
+    for (std::thread& worker : state->workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "../fits/fits_io.h"
+#include "../camera/camera.h"
+#include "../solver/solver.h"
+
+struct CameraPoolOptions {
+    int threads = 0;           // workers, <= 0 uses every hardware thread
+    size_t queue_capacity = 4; // frames waiting per camera; submit blocks beyond this
+
+    SolverOptions solver;
+};
+
+struct CameraResult {
+    int camera = 0;
+    uint64_t sequence = 0;  // per camera, counting from 0 in submission order
+    double timestamp = 0.0; // the frame's timestamp
+
+    // timings.total_ms runs from submit to the end of the solve, queueing included
+    SolveResult solve;
+};
+
+struct CameraPoolState;
+
+// Solves frames from several camera heads on one shared SolverContext.
+//
+// Each head is a serial queue: at most one worker holds a head at a time and
+// takes its frames in submission order, so results for one head come out in
+// order while different heads run in parallel. A head with frames waiting
+// sits in one worker's run queue (its home worker, camera % threads, when it
+// is first scheduled); idle workers steal heads from the other run queues,
+// and a worker puts the head back at the end of its own queue after every
+// frame so busy heads take turns. Scratch memory belongs to the workers, so
+// adding a camera only adds its CameraModel and its frame queue.
+//
+// on_result is called on the worker thread that solved the frame: calls for
+// one camera never overlap and arrive in order, calls for different cameras
+// may run concurrently.
+struct CameraPool {
+    std::unique_ptr<CameraPoolState> state;
+
+    CameraPool(std::shared_ptr<const SolverContext> context, const std::vector<CameraModel>& cameras,
+               const CameraPoolOptions& options, std::function<void(const CameraResult&)> on_result);
+    ~CameraPool();
+
+    CameraPool(const CameraPool&) = delete;
+    CameraPool& operator=(const CameraPool&) = delete;
+
+    // Queues frame (moved from) for camera, waiting while that camera's queue
+    // is full. False for an unknown camera or after finish(). Frames of one
+    // camera should come from one thread at a time, or their order is
+    // whatever order the submitting threads got through in.
+    bool submit(int camera, FrameBuffer& frame);
+
+    // Waits until every frame submitted so far has been delivered to on_result
+    void drain();
+
+    // drain() and stop the workers; further submits fail. Called by the destructor.
+    void finish();
+};
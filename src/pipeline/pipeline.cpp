@@ -0,0 +1,272 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include "pipeline.h"
+#include "../instrument/instrument.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Frame as it moves through the stages; each stage fills in its part
+struct FrameItem {
+    uint64_t sequence = 0;
+    std::string filename;
+    long plane = 0;
+
+    Clock::time_point start;
+    double read_detect_ms = 0.0; // work time only, queue waits excluded
+    FrameBuffer frame;
+    ImageData data;
+    PipelineResult result;
+};
+
+// Lock-free queue between two stages. Threads that find it empty (or full)
+// spin briefly and then park on a condition variable; the version counter
+// changes on every push, pop and close, and the mutex is only taken when
+// somebody is parked.
+struct StageQueue {
+    BoundedQueue<FrameItem> items;
+    std::atomic<bool> producers_done{false};
+
+    std::atomic<uint64_t> version{0};
+    std::atomic<int> parked{0};
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    explicit StageQueue(size_t capacity) : items(capacity) {}
+
+    void notify() {
+        version.fetch_add(1);
+        if (parked.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            changed.notify_all();
+        }
+    }
+
+    // Waits until version moves past seen (or a short timeout)
+    void park(uint64_t seen) {
+        parked.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait_for(lock, std::chrono::milliseconds(10), [&]() { return version.load() != seen; });
+        }
+        parked.fetch_sub(1);
+    }
+
+    void close() {
+        producers_done.store(true);
+        notify();
+    }
+};
+
+static void push_wait(StageQueue& queue, FrameItem& item) {
+    for (int spins = 0;; ++spins) {
+        uint64_t seen = queue.version.load();
+        if (queue.items.try_push(item)) break;
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            queue.park(seen);
+        }
+    }
+    queue.notify();
+}
+
+// False once the queue is empty and its producers have finished
+static bool pop_wait(StageQueue& queue, FrameItem& item) {
+    for (int spins = 0;; ++spins) {
+        uint64_t seen = queue.version.load();
+        if (queue.items.try_pop(item)) {
+            queue.notify();
+            return true;
+        }
+        if (queue.producers_done.load()) {
+            if (!queue.items.try_pop(item)) return false;
+            queue.notify();
+            return true;
+        }
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            queue.park(seen);
+        }
+    }
+}
+
+// source(emit) runs on its own thread and calls emit(filename, plane) for
+// every frame in input order
+static size_t run_stages(const std::function<void(const std::function<void(const std::string&, long)>&)>& source,
+                         const CameraModel& camera, const SolverDatabase& db, const PipelineOptions& options,
+                         const std::function<void(const PipelineResult&)>& on_result) {
+    StageQueue tasks(options.queue_capacity);
+    StageQueue read(options.queue_capacity);
+    StageQueue detected(options.queue_capacity);
+    StageQueue solved(options.queue_capacity);
+
+    std::vector<std::thread> threads;
+
+    threads.emplace_back([&]() {
+        uint64_t sequence = 0;
+        source([&](const std::string& filename, long plane) {
+            FrameItem item;
+            item.sequence = sequence++;
+            item.filename = filename;
+            item.plane = plane;
+            push_wait(tasks, item);
+        });
+        tasks.close();
+    });
+
+    // n workers moving items from in to out, each with its own scratch
+    // buffers kept across frames; the last one to finish closes out
+    auto start_stage = [&](int n, StageQueue& in, StageQueue& out, std::function<void(FrameItem&, SolverScratch&)> process) {
+        n = std::max(1, n);
+        auto remaining = std::make_shared<std::atomic<int>>(n);
+        for (int t = 0; t < n; ++t) {
+            threads.emplace_back([&in, &out, process, remaining]() {
+                SolverScratch scratch;
+                FrameItem item;
+                while (pop_wait(in, item)) {
+                    process(item, scratch);
+                    push_wait(out, item);
+                }
+                if (remaining->fetch_sub(1) == 1) {
+                    out.close();
+                }
+            });
+        }
+    };
+
+    start_stage(options.read_threads, tasks, read, [](FrameItem& item, SolverScratch&) {
+        item.start = Clock::now();
+        if (!fits_read_frame(item.filename, item.plane, item.frame)) {
+            item.frame = FrameBuffer();
+        }
+        item.read_detect_ms = elapsed_ms(item.start, Clock::now());
+
+        item.result.timestamp = item.frame.timestamp;
+        if (item.result.timestamp <= 0) {
+            item.result.timestamp = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+    });
+
+    start_stage(options.detect_threads, read, detected, [&options](FrameItem& item, SolverScratch& scratch) {
+        Clock::time_point start = Clock::now();
+        // the mask and labels stay with the worker; only the kept clusters move on
+        detect_frame(item.frame, options.solver.detection, scratch.detection, scratch.data);
+        item.data.clusters.assign(scratch.data.clusters.begin(), scratch.data.clusters.end());
+        item.frame = FrameBuffer(); // release the pixels early
+        item.read_detect_ms += elapsed_ms(start, Clock::now());
+    });
+
+    start_stage(options.solve_threads, detected, solved, [&camera, &db, &options](FrameItem& item, SolverScratch& scratch) {
+        Clock::time_point start = Clock::now();
+        scratch.body.resize(item.data.clusters.size());
+        clusters_to_stars(camera, item.data.clusters.data(), item.data.clusters.size(), scratch.body.data());
+        Clock::time_point converted = Clock::now();
+
+        item.result.solve = solve_stars(scratch.body, db, options.solver);
+        item.result.solve.timings.detect_ms = item.read_detect_ms;
+        item.result.solve.timings.convert_ms = elapsed_ms(start, converted);
+        item.result.solve.timings.total_ms = elapsed_ms(item.start, Clock::now());
+        item.data = ImageData();
+    });
+
+    // reorder on the calling thread
+    std::map<uint64_t, PipelineResult> pending;
+    uint64_t next = 0;
+    size_t count = 0;
+    FrameItem item;
+    while (pop_wait(solved, item)) {
+        item.result.sequence = item.sequence;
+        item.result.filename = item.filename;
+        item.result.plane = item.plane;
+        pending.emplace(item.sequence, std::move(item.result));
+
+        for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it)) {
+            on_result(it->second);
+            ++next;
+            ++count;
+        }
+    }
+
+    for (std::thread& th : threads) {
+        th.join();
+    }
+    return count;
+}
+
+size_t run_pipeline(const std::vector<std::string>& files, const CameraModel& camera, const SolverDatabase& db,
+                    const PipelineOptions& options, const std::function<void(const PipelineResult&)>& on_result) {
+    auto source = [&files](const std::function<void(const std::string&, long)>& emit) {
+        for (const std::string& filename : files) {
+            long planes = fits_plane_count(filename);
+            for (long plane = 0; plane < planes; ++plane) {
+                emit(filename, plane);
+            }
+        }
+    };
+    return run_stages(source, camera, db, options, on_result);
+}
+
+static bool is_fits_name(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".fits" || ext == ".fit" || ext == ".fts";
+}
+
+size_t watch_directory(const std::string& directory, const CameraModel& camera, const SolverDatabase& db,
+                       const PipelineOptions& options, const std::atomic<bool>& stop,
+                       const std::function<void(const PipelineResult&)>& on_result) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(directory, error)) {
+        std::cerr << "Error: " << directory << " is not a directory." << std::endl;
+        return 0;
+    }
+
+    auto source = [&](const std::function<void(const std::string&, long)>& emit) {
+        std::set<std::string> done;
+        std::map<std::string, uintmax_t> last_size; // files still being written
+
+        while (!stop.load()) {
+            std::vector<std::string> ready;
+            std::error_code list_error;
+            for (const auto& entry : std::filesystem::directory_iterator(directory, list_error)) {
+                if (!entry.is_regular_file() || !is_fits_name(entry.path())) continue;
+                std::string name = entry.path().string();
+                if (done.count(name)) continue;
+
+                // only take a file once its size has stopped changing between polls
+                std::error_code size_error;
+                uintmax_t size = entry.file_size(size_error);
+                if (size_error) continue;
+                auto it = last_size.find(name);
+                if (it != last_size.end() && it->second == size && size > 0) {
+                    ready.push_back(name);
+                    last_size.erase(it);
+                } else {
+                    last_size[name] = size;
+                }
+            }
+
+            std::sort(ready.begin(), ready.end());
+            for (const std::string& name : ready) {
+                done.insert(name);
+                long planes = fits_plane_count(name);
+                for (long plane = 0; plane < planes; ++plane) {
+                    emit(name, plane);
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(options.watch_poll_ms));
+        }
+    };
+    return run_stages(source, camera, db, options, on_result);
+}
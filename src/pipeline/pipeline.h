@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "../fits/fits_io.h"
+#include "../camera/camera.h"
+#include "../solver/solver.h"
+
+// Bounded multi-producer multi-consumer queue (Vyukov's array queue): each
+// slot carries a sequence number that tells producers and consumers whose
+// turn it is, so push and pop are a single CAS on the head or tail counter.
+template <typename T>
+struct BoundedQueue {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to push
+    alignas(64) std::atomic<size_t> head{0}; // next slot to pop
+
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Moves value in; false if the queue is full
+    bool try_push(T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Moves the oldest value out; false if the queue is empty
+    bool try_pop(T& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+struct PipelineOptions {
+    // worker threads per stage; the slowest stage sets the frame rate
+    int read_threads = 1;
+    int detect_threads = 2;
+    int solve_threads = 2;
+
+    size_t queue_capacity = 8; // frames buffered between two stages
+
+    SolverOptions solver;      // solver.detection is used by the detect stage
+
+    double watch_poll_ms = 50.0; // directory polling interval for watch_directory
+};
+
+// One output record; results are delivered in input order
+struct PipelineResult {
+    uint64_t sequence = 0;
+    std::string filename;
+    long plane = 0;     // plane within a data cube, 0 for 2-D images
+
+    // seconds since 1970: from DATE-OBS (+ plane * EXPTIME), or the time the
+    // frame was read if the header has no DATE-OBS
+    double timestamp = 0.0;
+
+    // solve.timings.detect_ms covers reading and detection; total_ms is the
+    // latency from the start of the read, including time spent in queues
+    SolveResult solve;
+};
+
+// Runs read -> detect -> solve as concurrent stages connected by bounded
+// lock-free queues. Each file may be a 2-D image or a data cube (every plane
+// is a frame). on_result is called on the calling thread, in input order.
+// Returns the number of frames processed.
+size_t run_pipeline(const std::vector<std::string>& files, const CameraModel& camera, const SolverDatabase& db,
+                    const PipelineOptions& options, const std::function<void(const PipelineResult&)>& on_result);
+
+// Live mode: processes every .fits/.fit/.fts file that appears in directory
+// (in name order) until stop is set, then drains the pipeline
+size_t watch_directory(const std::string& directory, const CameraModel& camera, const SolverDatabase& db,
+                       const PipelineOptions& options, const std::atomic<bool>& stop,
+                       const std::function<void(const PipelineResult&)>& on_result);
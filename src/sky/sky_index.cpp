@@ -0,0 +1,252 @@
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "sky_index.h"
+
+// Largest ID range the dense ID table is allowed to cover
+#define MAX_ID_RANGE (1 << 24)
+
+// Cell of a unit vector: the face is picked by the dominant axis and the
+// remaining two components are projected onto an n x n grid on that face.
+int sky_cell(double x, double y, double z, int n) {
+    double ax = std::abs(x), ay = std::abs(y), az = std::abs(z);
+    int face;
+    double u, v;
+    if (ax >= ay && ax >= az) {
+        face = (x > 0) ? 0 : 1;
+        u = y / ax;
+        v = z / ax;
+    } else if (ay >= az) {
+        face = (y > 0) ? 2 : 3;
+        u = x / ay;
+        v = z / ay;
+    } else {
+        face = (z > 0) ? 4 : 5;
+        u = x / az;
+        v = y / az;
+    }
+
+    int iu = std::min(n - 1, static_cast<int>((u + 1.0) * 0.5 * n));
+    int iv = std::min(n - 1, static_cast<int>((v + 1.0) * 0.5 * n));
+    return (face * n + iv) * n + iu;
+}
+
+// Unit vector through the face point (u, v) in [-1, 1]
+static void cube_point(int face, double u, double v, double out[3]) {
+    double p[3];
+    switch (face) {
+        case 0: p[0] = 1;  p[1] = u; p[2] = v; break;
+        case 1: p[0] = -1; p[1] = u; p[2] = v; break;
+        case 2: p[0] = u; p[1] = 1;  p[2] = v; break;
+        case 3: p[0] = u; p[1] = -1; p[2] = v; break;
+        case 4: p[0] = u; p[1] = v; p[2] = 1;  break;
+        default: p[0] = u; p[1] = v; p[2] = -1; break;
+    }
+    double mag = std::sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+    out[0] = p[0] / mag;
+    out[1] = p[1] / mag;
+    out[2] = p[2] / mag;
+}
+
+// Cell centers and radii, then for every cell the cells that can hold a star
+// within max_radius of any point in it (including the cell itself)
+static void build_cells(SkyIndex& index) {
+    const int n = index.grid;
+    const int num_cells = 6 * n * n;
+    std::vector<double> radii(num_cells, 0.0);
+    index.cell_centers.resize(num_cells * 3);
+
+    for (int cell = 0; cell < num_cells; ++cell) {
+        int face = cell / (n * n);
+        int iv = (cell / n) % n;
+        int iu = cell % n;
+        double u0 = -1.0 + 2.0 * iu / n, u1 = -1.0 + 2.0 * (iu + 1) / n;
+        double v0 = -1.0 + 2.0 * iv / n, v1 = -1.0 + 2.0 * (iv + 1) / n;
+
+        double* c = &index.cell_centers[cell * 3];
+        cube_point(face, 0.5 * (u0 + u1), 0.5 * (v0 + v1), c);
+
+        // cells are convex, so the farthest point from the center is a corner
+        const double corners[4][2] = {{u0, v0}, {u1, v0}, {u0, v1}, {u1, v1}};
+        for (const auto& corner : corners) {
+            double p[3];
+            cube_point(face, corner[0], corner[1], p);
+            double dot = std::clamp(c[0]*p[0] + c[1]*p[1] + c[2]*p[2], -1.0, 1.0);
+            radii[cell] = std::max(radii[cell], std::acos(dot));
+        }
+        index.cell_radius = std::max(index.cell_radius, radii[cell]);
+    }
+
+    // symmetric relation, so test each pair once; the bound with the largest
+    // cell radius rejects most pairs with a single dot product
+    const double far_dot = (2.0 * index.cell_radius + index.max_radius >= M_PI)
+        ? -2.0 : std::cos(2.0 * index.cell_radius + index.max_radius);
+    std::vector<std::vector<uint32_t>> lists(num_cells);
+    for (int i = 0; i < num_cells; ++i) {
+        const double* ci = &index.cell_centers[i * 3];
+        lists[i].push_back(i);
+        for (int j = i + 1; j < num_cells; ++j) {
+            const double* cj = &index.cell_centers[j * 3];
+            double dot = ci[0]*cj[0] + ci[1]*cj[1] + ci[2]*cj[2];
+            if (dot < far_dot) continue;
+
+            double reach = radii[i] + radii[j] + index.max_radius;
+            if (reach >= M_PI || dot >= std::cos(reach)) {
+                lists[i].push_back(j);
+                lists[j].push_back(i);
+            }
+        }
+    }
+
+    // nearest cells first, so small cones can stop early
+    index.neighbour_start.assign(num_cells + 1, 0);
+    index.neighbours.clear();
+    for (int i = 0; i < num_cells; ++i) {
+        const double* ci = &index.cell_centers[i * 3];
+        auto center_dot = [&](uint32_t j) {
+            const double* cj = &index.cell_centers[j * 3];
+            return ci[0]*cj[0] + ci[1]*cj[1] + ci[2]*cj[2];
+        };
+        std::sort(lists[i].begin(), lists[i].end(), [&](uint32_t j1, uint32_t j2) {
+            return center_dot(j1) > center_dot(j2);
+        });
+        index.neighbours.insert(index.neighbours.end(), lists[i].begin(), lists[i].end());
+        index.neighbour_start[i + 1] = index.neighbours.size();
+    }
+}
+
+SkyIndex build_sky_index(const std::vector<Star>& catalog, double max_radius, int grid) {
+    return build_sky_index(catalog.data(), catalog.size(), max_radius, grid);
+}
+
+SkyIndex build_sky_index(const Star* stars, size_t count, double max_radius, int grid) {
+    SkyIndex index;
+    index.max_radius = max_radius;
+    if (grid <= 0) {
+        // a face spans pi/2, so this gives cells about max_radius / 4 across
+        grid = static_cast<int>(std::ceil(2.0 * M_PI / std::max(max_radius, 1e-3)));
+    }
+    index.grid = std::clamp(grid, 1, 128);
+    build_cells(index);
+
+    // counting sort of the stars by cell
+    const int num_cells = 6 * index.grid * index.grid;
+    std::vector<int> star_cell(count);
+    index.cell_start.assign(num_cells + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        star_cell[i] = sky_cell(stars[i].x, stars[i].y, stars[i].z, index.grid);
+        index.cell_start[star_cell[i] + 1]++;
+    }
+    for (int c = 0; c < num_cells; ++c) {
+        index.cell_start[c + 1] += index.cell_start[c];
+    }
+
+    index.star_index.resize(count);
+    index.star_xyz.resize(count * 3);
+    std::vector<uint32_t> fill(index.cell_start.begin(), index.cell_start.end() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t slot = fill[star_cell[i]]++;
+        index.star_index[slot] = static_cast<uint32_t>(i);
+        index.star_xyz[slot * 3] = stars[i].x;
+        index.star_xyz[slot * 3 + 1] = stars[i].y;
+        index.star_xyz[slot * 3 + 2] = stars[i].z;
+    }
+
+    // dense ID table, or a sorted list when the IDs are spread too thin
+    if (count > 0) {
+        int min_id = stars[0].id, max_id = stars[0].id;
+        for (size_t i = 1; i < count; ++i) {
+            min_id = std::min(min_id, stars[i].id);
+            max_id = std::max(max_id, stars[i].id);
+        }
+        long range = static_cast<long>(max_id) - min_id + 1;
+        if (range > MAX_ID_RANGE) {
+            index.sparse_ids.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                index.sparse_ids[i] = {stars[i].id, static_cast<int32_t>(i)};
+            }
+            std::sort(index.sparse_ids.begin(), index.sparse_ids.end());
+        } else {
+            index.min_id = min_id;
+            index.id_table.assign(range, -1);
+            for (size_t i = 0; i < count; ++i) {
+                index.id_table[stars[i].id - min_id] = static_cast<int32_t>(i);
+            }
+        }
+    }
+
+    return index;
+}
+
+// Calls visit(slot, dot) for every star with dot(v, star) >= min_dot, where
+// radius = acos(min_dot). Cells whose bounding cap misses the cone are skipped.
+template <typename Visit>
+static void visit_cone(const SkyIndex& index, const Star& v, double radius, Visit visit) {
+    if (index.grid == 0) return;
+
+    const double min_dot = std::cos(radius);
+    const double cell_dot = (radius + index.cell_radius >= M_PI) ? -2.0 : std::cos(radius + index.cell_radius);
+
+    auto visit_cell = [&](uint32_t cell) {
+        const double* c = &index.cell_centers[cell * 3];
+        if (v.x * c[0] + v.y * c[1] + v.z * c[2] < cell_dot) return;
+
+        for (uint32_t s = index.cell_start[cell]; s < index.cell_start[cell + 1]; ++s) {
+            const double* p = &index.star_xyz[s * 3];
+            double dot = v.x * p[0] + v.y * p[1] + v.z * p[2];
+            if (dot >= min_dot) {
+                visit(s, dot);
+            }
+        }
+    };
+
+    if (radius <= index.max_radius) {
+        // v is within cell_radius of its cell's center, so once a neighbour's
+        // center is farther than radius + 2 cell_radius none of the rest can overlap
+        int cell = sky_cell(v.x, v.y, v.z, index.grid);
+        const double* ci = &index.cell_centers[cell * 3];
+        const double stop_dot = (radius + 2.0 * index.cell_radius >= M_PI) ? -2.0 : std::cos(radius + 2.0 * index.cell_radius);
+        for (uint32_t k = index.neighbour_start[cell]; k < index.neighbour_start[cell + 1]; ++k) {
+            uint32_t neighbour = index.neighbours[k];
+            const double* cj = &index.cell_centers[neighbour * 3];
+            if (ci[0]*cj[0] + ci[1]*cj[1] + ci[2]*cj[2] < stop_dot) break;
+            visit_cell(neighbour);
+        }
+    } else {
+        const uint32_t num_cells = 6 * index.grid * index.grid;
+        for (uint32_t cell = 0; cell < num_cells; ++cell) {
+            visit_cell(cell);
+        }
+    }
+}
+
+void cone_query(const SkyIndex& index, const Star& center, double radius, std::vector<uint32_t>& out) {
+    visit_cone(index, center, radius, [&](uint32_t slot, double) {
+        out.push_back(index.star_index[slot]);
+    });
+}
+
+long nearest_star(const SkyIndex& index, const Star& v, double max_angle) {
+    long best = -1;
+    double best_dot = -std::numeric_limits<double>::infinity();
+    visit_cone(index, v, max_angle, [&](uint32_t slot, double dot) {
+        long pos = index.star_index[slot];
+        if (dot > best_dot || (dot == best_dot && pos < best)) {
+            best_dot = dot;
+            best = pos;
+        }
+    });
+    return best;
+}
+
+long find_star_id(const SkyIndex& index, int id) {
+    if (!index.sparse_ids.empty()) {
+        auto it = std::lower_bound(index.sparse_ids.begin(), index.sparse_ids.end(), std::make_pair(id, INT32_MIN));
+        return it != index.sparse_ids.end() && it->first == id ? it->second : -1;
+    }
+    long slot = static_cast<long>(id) - index.min_id;
+    if (slot < 0 || slot >= static_cast<long>(index.id_table.size())) return -1;
+    return index.id_table[slot];
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "../catalog/catalog.h"
+
+// Cube-map partition of the sky over a catalog. Each face is split into
+// grid x grid cells; stars are stored grouped by cell (with a copy of their
+// unit vectors, so queries read contiguous memory) and every cell has a
+// precomputed list of the cells that can hold a star within max_radius of
+// any point inside it.
+struct SkyIndex {
+    int grid = 0;              // cells per face edge
+    double max_radius = 0.0;   // cone radius the neighbour lists cover
+    double cell_radius = 0.0;  // largest angular radius of any cell
+
+    std::vector<double> cell_centers;     // xyz per cell
+    std::vector<uint32_t> cell_start;     // 6 * grid^2 + 1 offsets into the star arrays
+    std::vector<uint32_t> star_index;     // catalog position, grouped by cell
+    std::vector<double> star_xyz;         // unit vector, same order
+
+    std::vector<uint32_t> neighbour_start; // 6 * grid^2 + 1 offsets into neighbours
+    std::vector<uint32_t> neighbours;      // each list sorted nearest cell first
+
+    // catalog ID - min_id -> position, -1 where no star has that ID
+    int min_id = 0;
+    std::vector<int32_t> id_table;
+
+    // (ID, position) sorted by ID, used instead of id_table when the IDs
+    // span more than 2^24 values
+    std::vector<std::pair<int, int32_t>> sparse_ids;
+};
+
+// Cell of a unit vector on a grid x grid cube map
+int sky_cell(double x, double y, double z, int grid);
+
+// grid <= 0 picks cells about a quarter of max_radius across
+SkyIndex build_sky_index(const std::vector<Star>& catalog, double max_radius, int grid = 0);
+SkyIndex build_sky_index(const Star* stars, size_t count, double max_radius, int grid = 0);
+
+// Appends the catalog positions of all stars with angle to center <= radius
+// (in no particular order). Cones wider than max_radius still work, they
+// just visit every cell.
+void cone_query(const SkyIndex& index, const Star& center, double radius, std::vector<uint32_t>& out);
+
+// Catalog position of the star closest to v within max_angle, -1 if none
+long nearest_star(const SkyIndex& index, const Star& v, double max_angle);
+
+// Catalog position of a star ID, -1 if it is not in the catalog
+long find_star_id(const SkyIndex& index, int id);
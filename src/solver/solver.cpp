@@ -0,0 +1,445 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include "solver.h"
+#include "../instrument/instrument.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double angle_between(const Star& s1, const Star& s2) {
+    double dot = s1.x * s2.x + s1.y * s2.y + s1.z * s2.z;
+    return std::acos(std::clamp(dot, -1.0, 1.0));
+}
+
+// Sign of s1 . (s2 x s3): tells a triangle from its mirror image
+static double triple_product(const Star& s1, const Star& s2, const Star& s3) {
+    return s1.x * (s2.y * s3.z - s2.z * s3.y) +
+           s1.y * (s2.z * s3.x - s2.x * s3.z) +
+           s1.z * (s2.x * s3.y - s2.y * s3.x);
+}
+
+SolverDatabase prepare_solver(const TriangleDatabase& db) {
+    SolverDatabase solver_db;
+    solver_db.stars = db.stars;
+    solver_db.star_count = db.star_count;
+    solver_db.triangles = db.triangles;
+    solver_db.triangle_count = db.triangle_count;
+
+    solver_db.index = build_triangle_index(db.triangles, db.triangle_count);
+    solver_db.sky = build_sky_index(db.stars, db.star_count, MAX_FOV_RAD);
+
+    return solver_db;
+}
+
+SolverDatabase prepare_solver(const std::vector<Star>& catalog, const std::vector<Triangle>& triangles) {
+    TriangleDatabase view;
+    view.stars = catalog.data();
+    view.star_count = catalog.size();
+    view.triangles = triangles.data();
+    view.triangle_count = triangles.size();
+    return prepare_solver(view);
+}
+
+void build_solver_patterns(SolverDatabase& db, const PatternOptions& options) {
+    db.patterns = build_pattern_table(db.stars, db.star_count, db.sky, options);
+}
+
+std::shared_ptr<const SolverContext> open_solver_context(const std::string& filename, bool patterns) {
+    auto context = std::make_shared<SolverContext>();
+    context->file = open_database(filename);
+    if (context->file.stars == nullptr) {
+        return nullptr;
+    }
+    context->db = prepare_solver(context->file);
+    if (patterns) {
+        build_solver_patterns(context->db);
+    }
+    return context;
+}
+
+std::shared_ptr<const SolverContext> make_solver_context(std::vector<Star> catalog, std::vector<Triangle> triangles, bool patterns) {
+    auto context = std::make_shared<SolverContext>();
+    context->catalog = std::move(catalog);
+    context->triangles = std::move(triangles);
+    context->db = prepare_solver(context->catalog, context->triangles);
+    if (patterns) {
+        build_solver_patterns(context->db);
+    }
+    return context;
+}
+
+// Assigns the three catalog stars of a matched triangle to the observed
+// stars: the permutation whose pairwise angles agree best, with the same
+// handedness. Returns false if no permutation has the right handedness.
+static bool correspond(const Star observed[3], const Star catalog[3], int order[3]) {
+    static const int permutations[6][3] = {
+        {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+    };
+
+    const double obs_sides[3] = {
+        angle_between(observed[0], observed[1]),
+        angle_between(observed[0], observed[2]),
+        angle_between(observed[1], observed[2])
+    };
+    const bool obs_sign = triple_product(observed[0], observed[1], observed[2]) > 0;
+
+    double best_error = std::numeric_limits<double>::infinity();
+    for (const auto& p : permutations) {
+        const Star& c0 = catalog[p[0]];
+        const Star& c1 = catalog[p[1]];
+        const Star& c2 = catalog[p[2]];
+        if ((triple_product(c0, c1, c2) > 0) != obs_sign) continue;
+
+        double error = std::abs(angle_between(c0, c1) - obs_sides[0]) +
+                       std::abs(angle_between(c0, c2) - obs_sides[1]) +
+                       std::abs(angle_between(c1, c2) - obs_sides[2]);
+        if (error < best_error) {
+            best_error = error;
+            std::copy(p, p + 3, order);
+        }
+    }
+
+    return best_error < std::numeric_limits<double>::infinity();
+}
+
+// Extends a three- or four-star hypothesis: every other body vector is rotated into
+// the inertial frame and paired with the nearest catalog star within the
+// tolerance that is not already taken.
+static void verify(const std::vector<Star>& body, const int* pattern, int pattern_size, const Quaternion& q,
+                   const SolverDatabase& db, double tolerance, std::vector<Observation>& matches) {
+    // the pattern's catalog stars are already taken
+    std::vector<int> used_ids;
+    for (const Observation& m : matches) {
+        used_ids.push_back(m.inertial.id);
+    }
+
+    uint64_t attempts = 0, verified = 0;
+    std::vector<uint32_t> cone;
+    for (size_t b = 0; b < body.size(); ++b) {
+        if (std::find(pattern, pattern + pattern_size, (int)b) != pattern + pattern_size) continue;
+        ++attempts;
+
+        const Star v = rotate_to_inertial(q, body[b]);
+        cone.clear();
+        cone_query(db.sky, v, tolerance, cone);
+
+        long best = -1;
+        double best_dot = -std::numeric_limits<double>::infinity();
+        for (uint32_t pos : cone) {
+            const Star& s = db.stars[pos];
+            if (std::find(used_ids.begin(), used_ids.end(), s.id) != used_ids.end()) continue;
+            double dot = v.x * s.x + v.y * s.y + v.z * s.z;
+            if (dot > best_dot || (dot == best_dot && pos < best)) {
+                best_dot = dot;
+                best = pos;
+            }
+        }
+        if (best < 0) continue;
+
+        const Star& s = db.stars[best];
+        used_ids.push_back(s.id);
+        matches.push_back({body[b], s, 1.0});
+        ++verified;
+    }
+    INSTRUMENT_COUNT(COUNTER_VERIFY_ATTEMPTS, attempts);
+    INSTRUMENT_COUNT(COUNTER_VERIFIED_STARS, verified);
+}
+
+// Second look at a hypothesis that reached min_verified: the attitude is
+// refitted to all its matches, every body vector is verified again around
+// the refit, and matches the final attitude puts outside the tolerance are
+// dropped until the rest agree. Chance hits of a wrong hypothesis pull the
+// refit away and do not survive. Returns whether min_verified matches remain.
+static bool confirm(const std::vector<Star>& body, const SolverDatabase& db, double tolerance, size_t min_verified,
+                    std::vector<Observation>& matches) {
+    Quaternion q = compute_attitude_quest(matches);
+    matches.clear();
+    verify(body, nullptr, 0, q, db, tolerance, matches);
+
+    const double min_dot = std::cos(tolerance);
+    while (matches.size() >= min_verified) {
+        q = compute_attitude_quest(matches);
+        size_t kept = 0;
+        for (size_t m = 0; m < matches.size(); ++m) {
+            Star predicted = rotate_to_body(q, matches[m].inertial);
+            const Star& b = matches[m].body;
+            if (predicted.x * b.x + predicted.y * b.y + predicted.z * b.z >= min_dot) {
+                matches[kept++] = matches[m];
+            }
+        }
+        if (kept == matches.size()) return true;
+        matches.resize(kept);
+    }
+    return false;
+}
+
+// Triples of the n brightest (order) until one verifies or time runs out
+static void search_triangles(const std::vector<Star>& body, const std::vector<int>& order, int n, const SolverDatabase& db,
+                             const SolverOptions& options, Clock::time_point start, SolveResult& result) {
+    // Pattern shifting (Mortari et al.): for each pair of index gaps (dj, dk),
+    // slide the triple (i, i+dj, i+dj+dk) across the brightness order
+    bool timed_out = false;
+    for (int dj = 1; dj < n - 1 && !result.solved && !timed_out; ++dj) {
+        for (int dk = 1; dj + dk < n && !result.solved && !timed_out; ++dk) {
+            for (int i = 0; i + dj + dk < n; ++i) {
+                Clock::time_point triple_start = Clock::now();
+                if (options.time_limit_ms > 0 && elapsed_ms(start, triple_start) > options.time_limit_ms) {
+                    timed_out = true;
+                    break;
+                }
+
+                const int triple[3] = {order[i], order[i + dj], order[i + dj + dk]};
+                const Star observed[3] = {body[triple[0]], body[triple[1]], body[triple[2]]};
+                result.triples_tried++;
+
+                Triangle match = find_triangle(observed[0], observed[1], observed[2], db.triangles, db.index);
+                if (match.star1 == -1) {
+                    result.timings.identify_ms += elapsed_ms(triple_start, Clock::now());
+                    continue;
+                }
+
+                long p1 = find_star_id(db.sky, match.star1);
+                long p2 = find_star_id(db.sky, match.star2);
+                long p3 = find_star_id(db.sky, match.star3);
+                if (p1 < 0 || p2 < 0 || p3 < 0) {
+                    result.timings.identify_ms += elapsed_ms(triple_start, Clock::now());
+                    continue;
+                }
+                const Star catalog[3] = {db.stars[p1], db.stars[p2], db.stars[p3]};
+
+                int assignment[3];
+                bool consistent = correspond(observed, catalog, assignment);
+                Clock::time_point identified = Clock::now();
+                result.timings.identify_ms += elapsed_ms(triple_start, identified);
+                if (!consistent) continue;
+                result.hypotheses++;
+
+                std::vector<Observation> matches;
+                for (int k = 0; k < 3; ++k) {
+                    matches.push_back({observed[k], catalog[assignment[k]], 1.0});
+                }
+                Quaternion q = compute_attitude_quest(matches);
+                verify(body, triple, 3, q, db, options.match_tolerance, matches);
+
+                if (matches.size() > result.verified_count) {
+                    result.verified_count = matches.size();
+                    result.matches = matches;
+                }
+                bool confirmed = matches.size() >= options.min_verified &&
+                                 confirm(body, db, options.match_tolerance, options.min_verified, matches);
+                result.timings.verify_ms += elapsed_ms(identified, Clock::now());
+                if (confirmed) {
+                    result.verified_count = matches.size();
+                    result.matches = matches;
+                    result.solved = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool correspond_pattern(const Star observed[4], const Star catalog[4], double tolerance, int order[4]) {
+    static const int pairs[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+    static const int triples[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+
+    double obs_sides[6];
+    for (int e = 0; e < 6; ++e) {
+        obs_sides[e] = angle_between(observed[pairs[e][0]], observed[pairs[e][1]]);
+    }
+    double cat_sides[4][4];
+    for (int a = 0; a < 4; ++a) {
+        for (int b = 0; b < 4; ++b) {
+            cat_sides[a][b] = a == b ? 0.0 : angle_between(catalog[a], catalog[b]);
+        }
+    }
+
+    // handedness from the observed triple farthest from collinear
+    int handed = 0;
+    double handed_value = 0.0;
+    for (int t = 0; t < 4; ++t) {
+        double v = triple_product(observed[triples[t][0]], observed[triples[t][1]], observed[triples[t][2]]);
+        if (std::abs(v) > std::abs(handed_value)) {
+            handed = t;
+            handed_value = v;
+        }
+    }
+    const int* ht = triples[handed];
+
+    int p[4] = {0, 1, 2, 3};
+    double best_error = std::numeric_limits<double>::infinity();
+    do {
+        double error = 0.0, worst = 0.0;
+        for (int e = 0; e < 6; ++e) {
+            double d = std::abs(cat_sides[p[pairs[e][0]]][p[pairs[e][1]]] - obs_sides[e]);
+            error += d;
+            worst = std::max(worst, d);
+        }
+        if (worst > tolerance || error >= best_error) continue;
+        if ((triple_product(catalog[p[ht[0]]], catalog[p[ht[1]]], catalog[p[ht[2]]]) > 0) != (handed_value > 0)) continue;
+
+        best_error = error;
+        std::copy(p, p + 4, order);
+    } while (std::next_permutation(p, p + 4));
+
+    return best_error < std::numeric_limits<double>::infinity();
+}
+
+// 4-star patterns of the n brightest, in order of their faintest member,
+// looked up in the pattern hash table until one verifies or time runs out
+static void search_patterns(const std::vector<Star>& body, const std::vector<int>& order, int n, const SolverDatabase& db,
+                            const SolverOptions& options, Clock::time_point start, SolveResult& result) {
+    // no catalog pattern is wider than twice the build radius
+    const double max_edge = 2.0 * db.patterns.options.radius + options.match_tolerance;
+    // a pattern brings one star more than a triple, so ask for one more
+    // verified star to keep the same number of independent confirmations
+    const size_t min_verified = options.min_verified + 1;
+    std::vector<const PatternEntry*> candidates;
+
+    for (int l = 3; l < n; ++l) {
+        for (int k = 2; k < l; ++k) {
+            for (int j = 1; j < k; ++j) {
+                for (int i = 0; i < j; ++i) {
+                    Clock::time_point pattern_start = Clock::now();
+                    if (options.time_limit_ms > 0 && elapsed_ms(start, pattern_start) > options.time_limit_ms) {
+                        return;
+                    }
+
+                    const int pattern[4] = {order[i], order[j], order[k], order[l]};
+                    const Star observed[4] = {body[pattern[0]], body[pattern[1]], body[pattern[2]], body[pattern[3]]};
+                    result.triples_tried++;
+
+                    double edges[6];
+                    pattern_edges(observed, edges);
+                    candidates.clear();
+                    if (edges[5] <= max_edge) {
+                        find_patterns(db.patterns, edges, options.match_tolerance, candidates);
+                    }
+                    result.timings.identify_ms += elapsed_ms(pattern_start, Clock::now());
+
+                    for (const PatternEntry* candidate : candidates) {
+                        Clock::time_point candidate_start = Clock::now();
+                        const Star catalog[4] = {db.stars[candidate->stars[0]], db.stars[candidate->stars[1]],
+                                                 db.stars[candidate->stars[2]], db.stars[candidate->stars[3]]};
+                        int assignment[4];
+                        bool consistent = correspond_pattern(observed, catalog, options.match_tolerance, assignment);
+                        Clock::time_point identified = Clock::now();
+                        result.timings.identify_ms += elapsed_ms(candidate_start, identified);
+                        if (!consistent) continue;
+                        result.hypotheses++;
+
+                        std::vector<Observation> matches;
+                        for (int m = 0; m < 4; ++m) {
+                            matches.push_back({observed[m], catalog[assignment[m]], 1.0});
+                        }
+                        Quaternion q = compute_attitude_quest(matches);
+                        verify(body, pattern, 4, q, db, options.match_tolerance, matches);
+
+                        if (matches.size() > result.verified_count) {
+                            result.verified_count = matches.size();
+                            result.matches = matches;
+                        }
+                        bool confirmed = matches.size() >= min_verified &&
+                                         confirm(body, db, options.match_tolerance, min_verified, matches);
+                        result.timings.verify_ms += elapsed_ms(identified, Clock::now());
+                        if (confirmed) {
+                            result.verified_count = matches.size();
+                            result.matches = matches;
+                            result.solved = true;
+                            return;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SolveResult solve_stars(const std::vector<Star>& body, const SolverDatabase& db, const SolverOptions& options) {
+    Clock::time_point start = Clock::now();
+    SolveResult result;
+    result.star_count = body.size();
+
+    const bool patterns = options.engine == ENGINE_PATTERNS;
+    if (body.size() < (patterns ? 4u : 3u) || (patterns ? db.patterns.count : db.triangle_count) == 0) {
+        result.timings.total_ms = elapsed_ms(start, Clock::now());
+        INSTRUMENT_COUNT(COUNTER_UNSOLVED, 1);
+        return result;
+    }
+
+    // brightest first (smallest magnitude)
+    std::vector<int> order(body.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int i, int j) {
+        return body[i].magnitude < body[j].magnitude;
+    });
+    const int n = static_cast<int>(std::min(options.max_stars, body.size()));
+
+    if (patterns) {
+        search_patterns(body, order, n, db, options, start, result);
+    } else {
+        search_triangles(body, order, n, db, options, start, result);
+    }
+
+    // a solved result's matches passed confirm, so this attitude is the
+    // refit they were last checked against
+    if (!result.matches.empty()) {
+        Clock::time_point attitude_start = Clock::now();
+        result.attitude = compute_attitude_quest(result.matches);
+        result.timings.attitude_ms = elapsed_ms(attitude_start, Clock::now());
+    }
+
+    result.timings.total_ms = elapsed_ms(start, Clock::now());
+
+    INSTRUMENT_COUNT(COUNTER_TRIPLES_TRIED, result.triples_tried);
+    INSTRUMENT_COUNT(COUNTER_HYPOTHESES, result.hypotheses);
+    INSTRUMENT_COUNT(result.solved ? COUNTER_SOLVED : COUNTER_UNSOLVED, 1);
+    INSTRUMENT_RECORD(STAGE_IDENTIFY, static_cast<uint64_t>(result.timings.identify_ms * 1e6));
+    INSTRUMENT_RECORD(STAGE_VERIFY, static_cast<uint64_t>(result.timings.verify_ms * 1e6));
+    INSTRUMENT_RECORD(STAGE_ATTITUDE, static_cast<uint64_t>(result.timings.attitude_ms * 1e6));
+    INSTRUMENT_RECORD(STAGE_SOLVE, static_cast<uint64_t>(result.timings.total_ms * 1e6));
+    return result;
+}
+
+SolveResult solve_frame(const std::string& filename, const CameraModel& camera, const SolverDatabase& db,
+                        const SolverOptions& options) {
+    Clock::time_point start = Clock::now();
+    ImageData data = fits_to_data(filename, options.detection);
+    Clock::time_point detected = Clock::now();
+
+    std::vector<Star> body = clusters_to_stars(camera, data.clusters);
+    Clock::time_point converted = Clock::now();
+
+    SolveResult result = solve_stars(body, db, options);
+    result.timings.detect_ms = elapsed_ms(start, detected);
+    result.timings.convert_ms = elapsed_ms(detected, converted);
+    result.timings.total_ms = elapsed_ms(start, Clock::now());
+
+    if (!result.solved) {
+        std::cerr << "Warning: no attitude solution for " << filename << " (" << body.size()
+                  << " stars, best hypothesis identified " << result.verified_count << ")." << std::endl;
+    }
+    return result;
+}
+
+SolveResult solve_frame(const FrameBuffer& frame, const CameraModel& camera, const SolverDatabase& db,
+                        const SolverOptions& options, SolverScratch& scratch) {
+    Clock::time_point start = Clock::now();
+    detect_frame(frame, options.detection, scratch.detection, scratch.data);
+    Clock::time_point detected = Clock::now();
+
+    scratch.body.resize(scratch.data.clusters.size());
+    clusters_to_stars(camera, scratch.data.clusters.data(), scratch.data.clusters.size(), scratch.body.data());
+    Clock::time_point converted = Clock::now();
+
+    SolveResult result = solve_stars(scratch.body, db, options);
+    result.timings.detect_ms = elapsed_ms(start, detected);
+    result.timings.convert_ms = elapsed_ms(detected, converted);
+    result.timings.total_ms = elapsed_ms(start, Clock::now());
+    return result;
+}
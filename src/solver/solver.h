@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "../catalog/catalog.h"
+#include "../triangle/triangle.h"
+#include "../triad/triad.h"
+#include "../fits/fits_io.h"
+#include "../camera/camera.h"
+#include "../database/database.h"
+#include "../sky/sky_index.h"
+#include "../pattern/pattern.h"
+
+// Catalog and triangle table plus the lookup structures the solver needs,
+// built once per database. The star and triangle arrays are not owned
+// (they usually point into a mapped TriangleDatabase or caller's vectors).
+struct SolverDatabase {
+    const Star* stars = nullptr;
+    size_t star_count = 0;
+
+    const Triangle* triangles = nullptr;
+    size_t triangle_count = 0;
+
+    TriangleIndex index;
+    SkyIndex sky; // cone / nearest-star queries and catalog ID lookup
+
+    PatternTable patterns; // empty unless build_solver_patterns was called
+};
+
+// Identification engine of solve_stars
+enum SolverEngine {
+    ENGINE_TRIANGLES, // triangle table lookups (find_triangle)
+    ENGINE_PATTERNS   // 4-star pattern hash (find_patterns); needs db.patterns
+};
+
+struct SolverOptions {
+    size_t max_stars = 20;          // brightest detections used to form triples
+    size_t min_verified = 5;        // identified stars (triple included) needed to accept
+    double match_tolerance = 0.002; // rad, verification radius
+    double time_limit_ms = 0.0;     // give up after this long, 0 = no limit
+    SolverEngine engine = ENGINE_TRIANGLES;
+
+    DetectionOptions detection;     // used by solve_frame
+};
+
+struct SolveTimings {
+    double detect_ms = 0.0;   // FITS read and cluster extraction
+    double convert_ms = 0.0;  // centroids -> body vectors
+    double identify_ms = 0.0; // triangle lookups and correspondence
+    double verify_ms = 0.0;   // checking hypotheses against the other stars
+    double attitude_ms = 0.0; // final QUEST attitude from all identified stars
+    double total_ms = 0.0;
+};
+
+struct SolveResult {
+    bool solved = false;
+    Quaternion attitude = {1, 0, 0, 0}; // inertial -> body
+
+    size_t star_count = 0;      // body vectors considered
+    size_t triples_tried = 0;   // 4-star patterns with ENGINE_PATTERNS
+    size_t hypotheses = 0;      // triples (or patterns) with a consistent catalog match
+    size_t verified_count = 0;  // stars identified in the accepted (or best) hypothesis
+
+    std::vector<Observation> matches; // identified stars of that hypothesis
+    SolveTimings timings;
+};
+
+// Detection and conversion buffers for solving frame after frame; one per
+// thread, reused across cameras
+struct SolverScratch {
+    DetectionWorkspace detection;
+    ImageData data;
+    std::vector<Star> body;
+};
+
+// A SolverDatabase that owns what it points into: the database mapping, or
+// copies of the catalog and triangle vectors. Nothing in it changes after
+// creation and the solver only reads it, so one context can be shared by
+// any number of threads and cameras.
+struct SolverContext {
+    TriangleDatabase file;           // set when opened from a database file
+    std::vector<Star> catalog;       // set when built from vectors
+    std::vector<Triangle> triangles;
+    SolverDatabase db;
+
+    SolverContext() = default;
+    SolverContext(const SolverContext&) = delete;
+    SolverContext& operator=(const SolverContext&) = delete;
+    ~SolverContext() { close_database(file); }
+};
+
+SolverDatabase prepare_solver(const TriangleDatabase& db);
+SolverDatabase prepare_solver(const std::vector<Star>& catalog, const std::vector<Triangle>& triangles);
+
+// Adds the 4-star pattern table for ENGINE_PATTERNS (built from db's catalog and sky index)
+void build_solver_patterns(SolverDatabase& db, const PatternOptions& options = PatternOptions());
+
+// nullptr if the database cannot be opened. patterns also builds the pattern table.
+std::shared_ptr<const SolverContext> open_solver_context(const std::string& filename, bool patterns = false);
+std::shared_ptr<const SolverContext> make_solver_context(std::vector<Star> catalog, std::vector<Triangle> triangles,
+                                                         bool patterns = false);
+
+// The solver functions below only read db, so concurrent calls on a shared
+// database are safe.
+
+// Lost-in-space identification of body-frame star vectors. Triples of the
+// max_stars brightest are tried brightest-first in pattern-shifting order,
+// which keeps a single bad detection out of consecutive triples, and the
+// search stops at the first hypothesis that identifies min_verified stars.
+// With ENGINE_PATTERNS, 4-star patterns of the max_stars brightest are
+// looked up in the pattern hash instead, in order of their faintest member.
+// Either way a hypothesis is only accepted if, after refitting the attitude
+// to all its matches and verifying again, min_verified matches lie within
+// match_tolerance of the refit; otherwise the search goes on.
+SolveResult solve_stars(const std::vector<Star>& body, const SolverDatabase& db, const SolverOptions& options = SolverOptions());
+
+// Assigns the four catalog stars of a pattern to the observed stars
+// (observed[i] is catalog[order[i]]): the permutation whose six angles agree
+// best, each within tolerance, with the same handedness. Returns false if
+// there is none.
+bool correspond_pattern(const Star observed[4], const Star catalog[4], double tolerance, int order[4]);
+
+// Detection, conversion through the camera model and solve_stars in one call
+SolveResult solve_frame(const std::string& filename, const CameraModel& camera, const SolverDatabase& db,
+                        const SolverOptions& options = SolverOptions());
+
+// Same steps on a frame already in memory, with detection and conversion
+// buffers taken from scratch
+SolveResult solve_frame(const FrameBuffer& frame, const CameraModel& camera, const SolverDatabase& db,
+                        const SolverOptions& options, SolverScratch& scratch);
@@ -0,0 +1,263 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+
+#include "synth.h"
+#include "../instrument/instrument.h"
+#include "fitsio.h" // CFITSIO, for USHORT_IMG
+
+typedef std::chrono::steady_clock Clock;
+
+#define ARCSEC_PER_RAD (180.0 * 3600.0 / M_PI)
+
+// Fraction of a unit Gaussian centered at c that falls in pixel i (centers at integers)
+static double pixel_fraction(long i, double c, double sigma) {
+    const double k = 1.0 / (std::sqrt(2.0) * sigma);
+    return 0.5 * (std::erf((i + 0.5 - c) * k) - std::erf((i - 0.5 - c) * k));
+}
+
+// Adds a pixel-integrated Gaussian spot with total flux to the image
+static void draw_spot(std::vector<double>& image, long width, long height, double x, double y,
+                      double flux, double sigma) {
+    const long r = static_cast<long>(std::ceil(4.0 * sigma));
+    long x0 = std::max(0L, static_cast<long>(std::floor(x)) - r);
+    long x1 = std::min(width - 1, static_cast<long>(std::floor(x)) + r + 1);
+    long y0 = std::max(0L, static_cast<long>(std::floor(y)) - r);
+    long y1 = std::min(height - 1, static_cast<long>(std::floor(y)) + r + 1);
+    if (x0 > x1 || y0 > y1) return;
+
+    // separable, so one row and one column of weights
+    std::vector<double> wx(x1 - x0 + 1);
+    for (long px = x0; px <= x1; ++px) {
+        wx[px - x0] = pixel_fraction(px, x, sigma);
+    }
+    for (long py = y0; py <= y1; ++py) {
+        double wy = flux * pixel_fraction(py, y, sigma);
+        double* row = &image[py * width];
+        for (long px = x0; px <= x1; ++px) {
+            row[px] += wy * wx[px - x0];
+        }
+    }
+}
+
+RenderedFrame render_frame(const Star* stars, const SkyIndex& sky, const Quaternion& attitude,
+                           const CameraModel& camera, const RenderOptions& options) {
+    RenderedFrame rendered;
+    const long width = camera.width, height = camera.height;
+    if (width <= 0 || height <= 0 || camera.focal_length <= 0 || camera.pixel_pitch <= 0) {
+        std::cerr << "Error: camera model has no sensor size or optics." << std::endl;
+        return rendered;
+    }
+    std::mt19937 rng(options.seed);
+
+    // stars whose spot can reach the sensor: the cone covers the farthest
+    // corner plus the PSF footprint
+    const double margin = std::ceil(4.0 * options.psf_sigma) + 1.0;
+    double radius = 0.0;
+    const double corners[4][2] = {{-margin, -margin}, {width + margin, -margin},
+                                  {-margin, height + margin}, {width + margin, height + margin}};
+    for (const auto& corner : corners) {
+        Star v = pixel_to_vector_exact(camera, corner[0], corner[1]);
+        radius = std::max(radius, std::acos(std::clamp(v.z, -1.0, 1.0)));
+    }
+
+    Star boresight = rotate_to_inertial(attitude, {0, 0.0, 0.0, 1.0, 0.0});
+    std::vector<uint32_t> in_cone;
+    cone_query(sky, boresight, radius, in_cone);
+
+    for (uint32_t pos : in_cone) {
+        const Star& s = stars[pos];
+        if (s.magnitude > options.magnitude_limit) continue;
+
+        double x, y;
+        if (!vector_to_pixel(camera, rotate_to_body(attitude, s), x, y)) continue;
+        if (x < -margin || y < -margin || x > width + margin || y > height + margin) continue;
+        rendered.stars.push_back({s.id, x, y, s.magnitude});
+    }
+
+    std::sort(rendered.stars.begin(), rendered.stars.end(), [](const RenderedStar& a, const RenderedStar& b) {
+        return a.magnitude < b.magnitude || (a.magnitude == b.magnitude && a.id < b.id);
+    });
+    if (options.max_stars > 0 && rendered.stars.size() > options.max_stars) {
+        rendered.stars.resize(options.max_stars);
+    }
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (size_t i = 0; i < options.false_stars; ++i) {
+        rendered.stars.push_back({-1, uniform(rng) * (width - 1), uniform(rng) * (height - 1), options.false_star_magnitude});
+    }
+
+    // background and gradient, then stars and hot pixels
+    std::vector<double> image(width * height);
+    for (long y = 0; y < height; ++y) {
+        double row_level = options.background + options.gradient_y * ((y + 0.5) / height - 0.5);
+        for (long x = 0; x < width; ++x) {
+            image[y * width + x] = row_level + options.gradient_x * ((x + 0.5) / width - 0.5);
+        }
+    }
+
+    for (const RenderedStar& s : rendered.stars) {
+        double flux = options.zero_point * std::pow(10.0, -0.4 * s.magnitude);
+        draw_spot(image, width, height, s.x, s.y, flux, options.psf_sigma);
+    }
+
+    std::uniform_int_distribution<long> pick(0, width * height - 1);
+    for (size_t i = 0; i < options.hot_pixels; ++i) {
+        image[pick(rng)] += options.hot_pixel_value;
+    }
+
+    // noise and quantization
+    rendered.frame.width = width;
+    rendered.frame.height = height;
+    rendered.frame.pixel_type = USHORT_IMG;
+    rendered.frame.pixels.resize(width * height * sizeof(uint16_t));
+    uint16_t* out = reinterpret_cast<uint16_t*>(rendered.frame.pixels.data());
+
+    std::normal_distribution<double> normal(0.0, 1.0);
+    const double max_value = std::min(options.saturation, 65535.0);
+    for (long i = 0; i < width * height; ++i) {
+        double value = image[i];
+        double variance = options.read_noise * options.read_noise;
+        if (options.shot_noise && value > 0) {
+            variance += value;
+        }
+        value += std::sqrt(variance) * normal(rng);
+        out[i] = static_cast<uint16_t>(std::clamp(std::round(value), 0.0, max_value));
+    }
+
+    return rendered;
+}
+
+// --- End-to-end sweep ---
+
+// Rotation angle between two attitudes, radians
+static double attitude_angle(const Quaternion& a, const Quaternion& b) {
+    double dot = std::abs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+    return 2.0 * std::acos(std::min(1.0, dot));
+}
+
+std::vector<SweepCell> run_sweep(const SolverDatabase& db, const CameraModel& camera, const SweepOptions& options) {
+    std::vector<SweepCell> cells;
+    std::mt19937 rng(options.seed);
+    const double pixel_angle = camera.pixel_pitch / camera.focal_length;
+
+    if (!options.fits_directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.fits_directory, error);
+        if (error) {
+            std::cerr << "Error: cannot create " << options.fits_directory << ": " << error.message() << std::endl;
+            return cells;
+        }
+    }
+
+    for (double read_noise : options.read_noise) {
+        for (size_t max_stars : options.max_stars) {
+            for (size_t false_stars : options.false_stars) {
+                SweepCell cell;
+                cell.read_noise = read_noise;
+                cell.max_stars = max_stars;
+                cell.false_stars = false_stars;
+
+                RenderOptions render = options.render;
+                render.read_noise = read_noise;
+                render.max_stars = max_stars;
+                render.false_stars = false_stars;
+
+                for (size_t f = 0; f < options.frames_per_cell; ++f) {
+                    Quaternion truth = random_attitude(rng);
+                    render.seed = rng();
+                    RenderedFrame rendered = render_frame(db.stars, db.sky, truth, camera, render);
+
+                    std::string filename;
+                    if (!options.fits_directory.empty()) {
+                        filename = (std::filesystem::path(options.fits_directory) /
+                                    ("sweep_" + std::to_string(cells.size()) + "_" + std::to_string(f) + ".fits")).string();
+                        if (!fits_write_frame(filename, rendered.frame)) {
+                            std::cerr << "Error: cannot write " << filename << ", sweep aborted." << std::endl;
+                            return {};
+                        }
+                    }
+
+                    // the clock covers everything from pixels (or file) to attitude
+                    Clock::time_point start = Clock::now();
+                    ImageData data = filename.empty() ? detect_frame(rendered.frame, options.solver.detection)
+                                                      : fits_to_data(filename, options.solver.detection);
+                    std::vector<Star> body = clusters_to_stars(camera, data.clusters);
+                    SolveResult result = solve_stars(body, db, options.solver);
+                    cell.fix_ms.push_back(elapsed_ms(start, Clock::now()));
+                    cell.frames++;
+
+                    if (!filename.empty()) {
+                        std::error_code error;
+                        std::filesystem::remove(filename, error);
+                    }
+                    if (!result.solved) continue;
+
+                    cell.solved++;
+                    double error = attitude_angle(truth, result.attitude);
+                    cell.attitude_error.push_back(error * ARCSEC_PER_RAD);
+                    if (error > 10.0 * options.correct_radius_px * pixel_angle) {
+                        cell.wrong++;
+                    }
+
+                    // a match is right if its catalog star really lands next to the detection
+                    for (const Observation& match : result.matches) {
+                        Star predicted = rotate_to_body(truth, match.inertial);
+                        double dot = predicted.x * match.body.x + predicted.y * match.body.y + predicted.z * match.body.z;
+                        double angle = std::acos(std::clamp(dot, -1.0, 1.0));
+                        cell.identified++;
+                        if (angle > options.correct_radius_px * pixel_angle) {
+                            cell.misidentified++;
+                        }
+                    }
+                }
+
+                cells.push_back(std::move(cell));
+            }
+        }
+    }
+
+    return cells;
+}
+
+// Nearest-rank percentiles of values (sorted in place)
+static void write_percentiles(std::ostringstream& out, std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double p) {
+        if (values.empty()) return 0.0;
+        size_t k = std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5));
+        return values[k];
+    };
+    out << "{\"p50\": " << percentile(0.50) << ", \"p90\": " << percentile(0.90)
+        << ", \"p99\": " << percentile(0.99) << ", \"max\": " << (values.empty() ? 0.0 : values.back()) << "}";
+}
+
+std::string sweep_to_json(const std::vector<SweepCell>& cells) {
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n  \"cells\": [\n";
+    for (size_t i = 0; i < cells.size(); ++i) {
+        const SweepCell& c = cells[i];
+        out << "    {\"read_noise\": " << c.read_noise
+            << ", \"max_stars\": " << c.max_stars
+            << ", \"false_stars\": " << c.false_stars
+            << ", \"frames\": " << c.frames
+            << ", \"solved\": " << c.solved
+            << ", \"solve_rate\": " << (c.frames ? static_cast<double>(c.solved) / c.frames : 0.0)
+            << ", \"wrong\": " << c.wrong
+            << ", \"identified\": " << c.identified
+            << ", \"misidentified\": " << c.misidentified
+            << ", \"fix_ms\": ";
+        write_percentiles(out, c.fix_ms);
+        out << ", \"attitude_error_arcsec\": ";
+        write_percentiles(out, c.attitude_error);
+        out << "}" << (i + 1 < cells.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
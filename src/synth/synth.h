@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "../catalog/catalog.h"
+#include "../triad/triad.h"
+#include "../fits/fits_io.h"
+#include "../camera/camera.h"
+#include "../sky/sky_index.h"
+#include "../solver/solver.h"
+
+// Sensor and scene parameters for a rendered frame. Fluxes are in ADU.
+struct RenderOptions {
+    double psf_sigma = 1.0;        // Gaussian PSF, pixels
+    double zero_point = 2.0e5;     // total flux of a magnitude 0 star
+    double magnitude_limit = 99.0; // catalog stars fainter than this are not drawn
+    size_t max_stars = 0;          // draw only the brightest N in the field, 0 = all
+
+    double background = 100.0;       // sky + bias at the frame center
+    double gradient_x = 0.0;         // background change across the full width
+    double gradient_y = 0.0;         // and the full height
+    double read_noise = 5.0;         // Gaussian, per pixel
+    bool shot_noise = true;          // Poisson noise on the signal (normal approximation)
+
+    size_t hot_pixels = 0;
+    double hot_pixel_value = 4000.0; // added on top of the background
+
+    size_t false_stars = 0;          // spots at random positions with no catalog star
+    double false_star_magnitude = 4.0;
+
+    double saturation = 65535.0;
+    uint32_t seed = 1;
+};
+
+// Where a star (or false star) was drawn
+struct RenderedStar {
+    int id;          // catalog ID, -1 for a false star
+    double x, y;     // pixel position of the PSF center
+    double magnitude;
+};
+
+struct RenderedFrame {
+    FrameBuffer frame; // USHORT_IMG, camera.width x camera.height
+    std::vector<RenderedStar> stars;
+};
+
+// Renders the catalog as seen by camera at attitude (inertial -> body).
+// sky must be built over stars; the cone query covers the full sensor
+// diagonal, so stars just outside the frame still spill light into it.
+RenderedFrame render_frame(const Star* stars, const SkyIndex& sky, const Quaternion& attitude,
+                           const CameraModel& camera, const RenderOptions& options);
+
+// --- End-to-end sweep ---
+
+// Every combination of read_noise, max_stars and false_stars is one cell of
+// the sweep; each cell gets frames_per_cell random attitudes.
+struct SweepOptions {
+    size_t frames_per_cell = 200;
+    std::vector<double> read_noise = {2.0, 5.0, 10.0, 20.0};
+    std::vector<size_t> max_stars = {0, 12, 6};
+    std::vector<size_t> false_stars = {0, 3};
+
+    RenderOptions render;   // base settings; the swept fields are overridden
+    SolverOptions solver;
+
+    // write every frame to this directory and detect with fits_to_data, so the
+    // file read is part of the timing; empty = detect straight from memory
+    std::string fits_directory;
+
+    double correct_radius_px = 3.0; // an identified star is correct within this of its true position
+    uint32_t seed = 1;
+};
+
+struct SweepCell {
+    double read_noise = 0.0;
+    size_t max_stars = 0;
+    size_t false_stars = 0;
+
+    size_t frames = 0;
+    size_t solved = 0;
+    size_t wrong = 0;            // solved, but off by more than 10 * correct_radius_px worth of angle
+
+    std::vector<double> fix_ms;          // detection to attitude (or to giving up), per frame
+    std::vector<double> attitude_error;  // arcsec, per solved frame
+    size_t identified = 0;               // matches over all solved frames
+    size_t misidentified = 0;            // of those, matched to the wrong catalog star
+};
+
+// Renders (from db's catalog and sky index), detects, converts and solves
+// frames_per_cell frames per cell. Empty when fits_directory cannot be
+// created or a frame cannot be written to it.
+std::vector<SweepCell> run_sweep(const SolverDatabase& db, const CameraModel& camera, const SweepOptions& options);
+
+// Percentiles of time-to-fix and attitude error plus identification rates, one object per cell
+std::string sweep_to_json(const std::vector<SweepCell>& cells);
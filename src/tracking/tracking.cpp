@@ -0,0 +1,163 @@
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "tracking.h"
+#include "../instrument/instrument.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Hamilton product; rotate_to_body(a * b, v) = rotate_to_body(a, rotate_to_body(b, v))
+static Quaternion multiply(const Quaternion& a, const Quaternion& b) {
+    return {
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+    };
+}
+
+static Quaternion normalized(const Quaternion& q) {
+    double mag = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    if (mag == 0.0) return {1, 0, 0, 0};
+    return {q.w / mag, q.x / mag, q.y / mag, q.z / mag};
+}
+
+Quaternion propagate_attitude(const Quaternion& q, const double rate[3], double dt) {
+    double speed = std::sqrt(rate[0] * rate[0] + rate[1] * rate[1] + rate[2] * rate[2]);
+    double angle = speed * dt;
+    if (speed == 0.0 || angle == 0.0) return q;
+
+    // seen from the body, the sky turns by -angle about the rate axis
+    double s = -std::sin(0.5 * angle) / speed;
+    Quaternion delta = {std::cos(0.5 * angle), rate[0] * s, rate[1] * s, rate[2] * s};
+    return normalized(multiply(delta, q));
+}
+
+void measure_rate(const Quaternion& before, const Quaternion& after, double dt, double rate[3]) {
+    Quaternion delta = multiply(after, {before.w, -before.x, -before.y, -before.z});
+    if (delta.w < 0) {
+        delta = {-delta.w, -delta.x, -delta.y, -delta.z};
+    }
+    double v = std::sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+    double scale = v > 0.0 ? -2.0 * std::atan2(v, delta.w) / (v * dt) : 0.0;
+    rate[0] = delta.x * scale;
+    rate[1] = delta.y * scale;
+    rate[2] = delta.z * scale;
+}
+
+// One association pass around attitude q. state.candidates holds the catalog
+// positions of the stars that can be in the field.
+static void associate(const std::vector<Star>& body, const Quaternion& q, const SolverDatabase& db, double gate,
+                      TrackingState& state, std::vector<Observation>& matches) {
+    const size_t n = state.candidates.size();
+    state.predicted.resize(n);
+    for (size_t j = 0; j < n; ++j) {
+        state.predicted[j] = rotate_to_body(q, db.stars[state.candidates[j]]);
+    }
+
+    // claims[j]: detection that took predicted star j, -1 none, -2 more than one
+    state.claims.assign(n, -1);
+    const double min_dot = std::cos(gate);
+    for (size_t i = 0; i < body.size(); ++i) {
+        const Star& b = body[i];
+        long best = -1;
+        int in_gate = 0;
+        double best_dot = min_dot;
+        for (size_t j = 0; j < n; ++j) {
+            const Star& p = state.predicted[j];
+            double dot = b.x * p.x + b.y * p.y + b.z * p.z;
+            if (dot < min_dot) continue;
+            ++in_gate;
+            if (dot >= best_dot) {
+                best_dot = dot;
+                best = j;
+            }
+        }
+        if (in_gate != 1) continue; // nothing, or ambiguous
+
+        int& claim = state.claims[best];
+        claim = claim == -1 ? static_cast<int>(i) : -2;
+    }
+
+    matches.clear();
+    for (size_t j = 0; j < n; ++j) {
+        if (state.claims[j] >= 0) {
+            matches.push_back({body[state.claims[j]], db.stars[state.candidates[j]], 1.0});
+        }
+    }
+}
+
+bool track_stars(const std::vector<Star>& body, const Quaternion& predicted, const SolverDatabase& db,
+                 const TrackingOptions& options, TrackingState& scratch, SolveResult& result) {
+    result = SolveResult();
+    result.star_count = body.size();
+    if (body.size() < 3 || db.star_count == 0) {
+        return false;
+    }
+
+    // the field is the cone around the boresight (+z) that holds every detection
+    double radius = 0.0;
+    for (const Star& b : body) {
+        radius = std::max(radius, std::acos(std::clamp(b.z, -1.0, 1.0)));
+    }
+    Star boresight = rotate_to_inertial(predicted, {0, 0.0, 0.0, 1.0, 0.0});
+    scratch.candidates.clear();
+    cone_query(db.sky, boresight, radius + options.gate, scratch.candidates);
+
+    associate(body, predicted, db, options.gate, scratch, result.matches);
+    if (result.matches.size() < 3) {
+        result.verified_count = result.matches.size();
+        return false;
+    }
+
+    Quaternion refined = compute_attitude_quest(result.matches);
+    associate(body, refined, db, options.solver.match_tolerance, scratch, result.matches);
+    result.verified_count = result.matches.size();
+    if (result.matches.size() < std::max<size_t>(options.min_matched, 3)) {
+        return false;
+    }
+
+    result.attitude = compute_attitude_quest(result.matches);
+    result.solved = true;
+    return true;
+}
+
+TrackResult track_frame(const std::vector<Star>& body, double timestamp, TrackingState& state,
+                        const SolverDatabase& db, const TrackingOptions& options) {
+    TrackResult track;
+    const double dt = timestamp - state.timestamp;
+
+    if (state.valid) {
+        Clock::time_point start = Clock::now();
+        track.predicted = propagate_attitude(state.attitude, state.rate, dt);
+        track.tracked = track_stars(body, track.predicted, db, options, state, track.solve);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        track.track_us = elapsed / 1000.0;
+        track.solve.timings.total_ms = elapsed / 1e6;
+        INSTRUMENT_RECORD(STAGE_TRACK, elapsed);
+    }
+
+    if (track.tracked) {
+        INSTRUMENT_COUNT(COUNTER_TRACKED, 1);
+    } else if (options.fallback) {
+        INSTRUMENT_COUNT(COUNTER_TRACK_FALLBACKS, 1);
+        track.fell_back = true;
+        track.solve = solve_stars(body, db, options.solver);
+    }
+
+    if (track.solve.solved) {
+        if (state.valid && options.estimate_rate && dt > 0) {
+            double measured[3];
+            measure_rate(state.attitude, track.solve.attitude, dt, measured);
+            for (int k = 0; k < 3; ++k) {
+                state.rate[k] += options.rate_gain * (measured[k] - state.rate[k]);
+            }
+        }
+        state.attitude = track.solve.attitude;
+        state.timestamp = timestamp;
+        state.valid = true;
+    }
+    return track;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "../catalog/catalog.h"
+#include "../triad/triad.h"
+#include "../sky/sky_index.h"
+#include "../solver/solver.h"
+
+struct TrackingOptions {
+    // Largest angle between a detection and its predicted catalog star on the
+    // first association pass; has to cover the prior's error plus the rate
+    // error times the frame interval. The second pass, around the refined
+    // attitude, uses solver.match_tolerance.
+    double gate = 0.005; // rad
+
+    size_t min_matched = 5;    // associations needed on the second pass to accept
+    bool fallback = true;      // lost-in-space solve when association fails
+    bool estimate_rate = true; // track_frame updates the rate from consecutive attitudes
+    double rate_gain = 0.5;    // weight of the newest rate measurement
+
+    SolverOptions solver;      // match_tolerance for the second pass, and the fallback solve
+};
+
+// Recursive tracking state for one camera
+struct TrackingState {
+    bool valid = false;                 // attitude holds a solution
+    Quaternion attitude = {1, 0, 0, 0}; // inertial -> body, at timestamp
+    double rate[3] = {0.0, 0.0, 0.0};   // body-frame angular rate, rad/s (or set from a gyro)
+    double timestamp = 0.0;             // seconds
+
+    // reused between frames
+    std::vector<uint32_t> candidates;
+    std::vector<Star> predicted;
+    std::vector<int> claims;
+};
+
+struct TrackResult {
+    SolveResult solve;                   // attitude and identified stars, from tracking or the fallback
+    bool tracked = false;                // identified by association, no pattern search
+    bool fell_back = false;              // lost-in-space solve ran
+    Quaternion predicted = {1, 0, 0, 0}; // prior propagated to this frame
+    double track_us = 0.0;               // association and attitude, fallback excluded
+};
+
+// Attitude after dt seconds of constant body-frame rate (rad/s)
+Quaternion propagate_attitude(const Quaternion& q, const double rate[3], double dt);
+
+// Body rate that takes before to after in dt seconds, the inverse of
+// propagate_attitude for rotations of less than half a turn
+void measure_rate(const Quaternion& before, const Quaternion& after, double dt, double rate[3]);
+
+// Identifies body vectors against the catalog stars predicted by attitude:
+// every catalog star within the detections' field (plus the gate) is
+// rotated into the body frame and each detection takes the nearest one
+// inside the gate. Ambiguous detections (two stars in the gate) and stars
+// claimed by two detections are left out. QUEST on the associations gives a
+// refined attitude, association is repeated with solver.match_tolerance and
+// QUEST runs again. result.solved is set with min_matched associations.
+bool track_stars(const std::vector<Star>& body, const Quaternion& predicted, const SolverDatabase& db,
+                 const TrackingOptions& options, TrackingState& scratch, SolveResult& result);
+
+// One frame of recursive tracking: propagates state to timestamp, tracks,
+// falls back to solve_stars when tracking fails (or state holds no
+// solution), and on success stores the new attitude (and rate estimate).
+TrackResult track_frame(const std::vector<Star>& body, double timestamp, TrackingState& state,
+                        const SolverDatabase& db, const TrackingOptions& options = TrackingOptions());
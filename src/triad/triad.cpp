@@ -120,4 +120,187 @@ Quaternion compute_attitude(const std::vector<Observation>& obs) {
     }
 
     return q;
-}
\ No newline at end of file
+}
+
+// --- Rotations ---
+
+// v' = v + 2w (u x v) + 2 u x (u x v), with u the vector part of q
+static Star rotate(double w, double ux, double uy, double uz, const Star& v) {
+    double tx = 2.0 * (uy * v.z - uz * v.y);
+    double ty = 2.0 * (uz * v.x - ux * v.z);
+    double tz = 2.0 * (ux * v.y - uy * v.x);
+    return {
+        v.id,
+        v.x + w * tx + (uy * tz - uz * ty),
+        v.y + w * ty + (uz * tx - ux * tz),
+        v.z + w * tz + (ux * ty - uy * tx),
+        v.magnitude
+    };
+}
+
+Star rotate_to_body(const Quaternion& q, const Star& r) {
+    return rotate(q.w, q.x, q.y, q.z, r);
+}
+
+Star rotate_to_inertial(const Quaternion& q, const Star& b) {
+    return rotate(q.w, -q.x, -q.y, -q.z, b);
+}
+
+// --- QUEST ---
+
+// Optimal quaternion for the attitude profile matrix B = sum w b r^T, given
+// the largest eigenvalue guess lambda0 = sum w. Writes Shuster's (x, gamma)
+// and returns gamma^2 + |x|^2, which goes to zero for 180 degree rotations.
+static double quest_solve(const double B[3][3], double lambda0, double q_out[4]) {
+    double S[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            S[i][j] = B[i][j] + B[j][i];
+        }
+    }
+    double sigma = B[0][0] + B[1][1] + B[2][2];
+    double Z[3] = {B[1][2] - B[2][1], B[2][0] - B[0][2], B[0][1] - B[1][0]};
+
+    double det_S = S[0][0] * (S[1][1] * S[2][2] - S[1][2] * S[2][1])
+                 - S[0][1] * (S[1][0] * S[2][2] - S[1][2] * S[2][0])
+                 + S[0][2] * (S[1][0] * S[2][1] - S[1][1] * S[2][0]);
+    double kappa = (S[1][1] * S[2][2] - S[1][2] * S[2][1])
+                 + (S[0][0] * S[2][2] - S[0][2] * S[2][0])
+                 + (S[0][0] * S[1][1] - S[0][1] * S[1][0]); // trace of adj(S)
+
+    double SZ[3], S2Z[3];
+    for (int i = 0; i < 3; ++i) {
+        SZ[i] = S[i][0] * Z[0] + S[i][1] * Z[1] + S[i][2] * Z[2];
+    }
+    for (int i = 0; i < 3; ++i) {
+        S2Z[i] = S[i][0] * SZ[0] + S[i][1] * SZ[1] + S[i][2] * SZ[2];
+    }
+    double zz = Z[0] * Z[0] + Z[1] * Z[1] + Z[2] * Z[2];
+
+    // characteristic equation of K: l^4 - (a + b) l^2 - c l + (a b + c sigma - d) = 0
+    double a = sigma * sigma - kappa;
+    double b = sigma * sigma + zz;
+    double c = det_S + (Z[0] * SZ[0] + Z[1] * SZ[1] + Z[2] * SZ[2]);
+    double d = Z[0] * S2Z[0] + Z[1] * S2Z[1] + Z[2] * S2Z[2];
+    double constant = a * b + c * sigma - d;
+
+    // Newton from sum w converges in a couple of steps
+    double lambda = lambda0;
+    for (int it = 0; it < 10; ++it) {
+        double l2 = lambda * lambda;
+        double f = (l2 - (a + b)) * l2 - c * lambda + constant;
+        double df = 4.0 * l2 * lambda - 2.0 * (a + b) * lambda - c;
+        if (df == 0.0) break;
+        double step = f / df;
+        lambda -= step;
+        if (std::abs(step) < 1e-12 * lambda0) break;
+    }
+
+    double alpha = lambda * lambda - sigma * sigma + kappa;
+    double beta = lambda - sigma;
+    double gamma = (lambda + sigma) * alpha - det_S;
+
+    // x = (alpha I + beta S + S^2) Z
+    for (int i = 0; i < 3; ++i) {
+        q_out[i] = alpha * Z[i] + beta * SZ[i] + S2Z[i];
+    }
+    q_out[3] = gamma;
+
+    return q_out[0] * q_out[0] + q_out[1] * q_out[1] + q_out[2] * q_out[2] + gamma * gamma;
+}
+
+static Quaternion quest(const Observation* obs, size_t count) {
+    if (count < 2) return {1, 0, 0, 0};
+
+    double total = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        total += obs[i].weight;
+    }
+    const bool unit_weights = !(total > 0.0);
+    if (unit_weights) total = static_cast<double>(count);
+
+    // attitude profile matrix, one pass; scalar accumulators so the loop
+    // stays in registers
+    double b00 = 0, b01 = 0, b02 = 0, b10 = 0, b11 = 0, b12 = 0, b20 = 0, b21 = 0, b22 = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const Star& b = obs[i].body;
+        const Star& r = obs[i].inertial;
+        double w = unit_weights ? 1.0 : obs[i].weight;
+
+        double wbx = w * b.x, wby = w * b.y, wbz = w * b.z;
+        b00 += wbx * r.x; b01 += wbx * r.y; b02 += wbx * r.z;
+        b10 += wby * r.x; b11 += wby * r.y; b12 += wby * r.z;
+        b20 += wbz * r.x; b21 += wbz * r.y; b22 += wbz * r.z;
+    }
+    const double B[3][3] = {{b00, b01, b02}, {b10, b11, b12}, {b20, b21, b22}};
+
+    double q[4];
+    double norm2 = quest_solve(B, total, q);
+
+    // Near 180 degrees the solution is ill-conditioned: solve for the
+    // reference frame turned 180 degrees about the axis that gives the best
+    // conditioned problem (B P flips the other two columns), then undo it.
+    int flip_axis = -1;
+    if (norm2 < 1e-4 * std::pow(total, 6)) {
+        double best = norm2;
+        for (int axis = 0; axis < 3; ++axis) {
+            double Bp[3][3];
+            for (int j = 0; j < 3; ++j) {
+                for (int k = 0; k < 3; ++k) {
+                    Bp[j][k] = (k == axis) ? B[j][k] : -B[j][k];
+                }
+            }
+            double qp[4];
+            double n2 = quest_solve(Bp, total, qp);
+            if (n2 > best) {
+                best = n2;
+                flip_axis = axis;
+                std::copy(qp, qp + 4, q);
+            }
+        }
+        norm2 = best;
+    }
+
+    // Shuster's quaternion describes the frame rotation; the conjugate is the
+    // rotation that maps inertial vectors onto body vectors
+    double inv = 1.0 / std::sqrt(norm2);
+    Quaternion result = {q[3] * inv, -q[0] * inv, -q[1] * inv, -q[2] * inv};
+
+    if (flip_axis >= 0) {
+        // result * p, with p the 180 degree rotation (0, e_axis)
+        double p[3] = {0, 0, 0};
+        p[flip_axis] = 1.0;
+        Quaternion r = result;
+        result.w = -(r.x * p[0] + r.y * p[1] + r.z * p[2]);
+        result.x = r.w * p[0] + (r.y * p[2] - r.z * p[1]);
+        result.y = r.w * p[1] + (r.z * p[0] - r.x * p[2]);
+        result.z = r.w * p[2] + (r.x * p[1] - r.y * p[0]);
+    }
+
+    if (result.w < 0) {
+        result = {-result.w, -result.x, -result.y, -result.z};
+    }
+    return result;
+}
+
+Quaternion compute_attitude_quest(const std::vector<Observation>& obs) {
+    return quest(obs.data(), obs.size());
+}
+
+Quaternion compute_attitude_quest(const Observation* obs, size_t count) {
+    return quest(obs, count);
+}
+
+void compute_attitude_quest(const Observation* obs, const size_t* offsets, size_t num_sets, Quaternion* out) {
+    for (size_t i = 0; i < num_sets; ++i) {
+        out[i] = quest(obs + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+}
+
+Quaternion random_attitude(std::mt19937& rng) {
+    // a normalized 4D Gaussian is uniform on the unit quaternion sphere
+    std::normal_distribution<double> normal(0.0, 1.0);
+    Quaternion q = {normal(rng), normal(rng), normal(rng), normal(rng)};
+    double mag = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return {q.w / mag, q.x / mag, q.y / mag, q.z / mag};
+}
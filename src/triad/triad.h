@@ -3,6 +3,8 @@
 #include "../catalog/catalog.h"
 
 #include <vector>
+#include <cstddef>
+#include <random>
 
 struct Quaternion {
     double w, x, y, z;
@@ -14,4 +16,25 @@ struct Observation {
     double weight;
 };
 
-Quaternion compute_attitude(const std::vector<Observation>& obs);
\ No newline at end of file
+// TRIAD: exact on the first two observations, ignores the rest and the weights
+Quaternion compute_attitude(const std::vector<Observation>& obs);
+
+// Weighted least-squares attitude over all observations (Davenport's
+// q-method solved with Shuster's QUEST). No allocations. Vectors must be
+// unit length; if the weights do not sum to a positive value every
+// observation gets weight 1.
+Quaternion compute_attitude_quest(const std::vector<Observation>& obs);
+Quaternion compute_attitude_quest(const Observation* obs, size_t count);
+
+// Solves num_sets independent observation sets: set i is
+// obs[offsets[i]] .. obs[offsets[i + 1] - 1] and its attitude goes to out[i]
+void compute_attitude_quest(const Observation* obs, const size_t* offsets, size_t num_sets, Quaternion* out);
+
+// q maps inertial vectors into the body frame: b = R(q) r
+Star rotate_to_body(const Quaternion& q, const Star& r);
+
+// Inverse rotation, body frame -> inertial
+Star rotate_to_inertial(const Quaternion& q, const Star& b);
+
+// Attitude drawn uniformly over all rotations
+Quaternion random_attitude(std::mt19937& rng);
@@ -1,67 +1,159 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <unordered_map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "triangle.h"
+#include "../sky/sky_index.h"
+#include "../instrument/instrument.h"
+
+static bool triangle_less(const Triangle& t1, const Triangle& t2) {
+    if (t1.a != t2.a) return t1.a < t2.a;
+    if (t1.star1 != t2.star1) return t1.star1 < t2.star1;
+    if (t1.star2 != t2.star2) return t1.star2 < t2.star2;
+    return t1.star3 < t2.star3;
+}
 
 std::vector<Triangle> catalog_to_triangles(const std::vector<Star>& catalog) {
-    std::vector<Triangle> triangles;
-    int n = catalog.size();
-
-    for (int i = 0; i < n; ++i) {
-        for (int j = i + 1; j < n; ++j) {
-            double dot_ab = catalog[i].x*catalog[j].x + catalog[i].y*catalog[j].y + catalog[i].z*catalog[j].z;
-            dot_ab = std::clamp(dot_ab, -1.0, 1.0);
-            double dist_ab = acos(dot_ab);
-            if (dist_ab > MAX_FOV_RAD) continue;
-
-            for (int k = j + 1; k < n; ++k) {
-                double dot_ac = catalog[i].x*catalog[k].x + catalog[i].y*catalog[k].y + catalog[i].z*catalog[k].z;
-                dot_ac = std::clamp(dot_ac, -1.0, 1.0);
-                double dist_ac = acos(dot_ac);
-                if (dist_ac > MAX_FOV_RAD) continue;
-
-                double dot_bc = catalog[j].x*catalog[k].x + catalog[j].y*catalog[k].y + catalog[j].z*catalog[k].z;
-                dot_bc = std::clamp(dot_bc, -1.0, 1.0);
-                double dist_bc = acos(dot_bc);
-                if (dist_bc > MAX_FOV_RAD) continue;
-
-                Triangle t;
-                t.star1 = catalog[i].id;
-                t.star2 = catalog[j].id;
-                t.star3 = catalog[k].id;
-                
-                double sides[3] = {dist_ab, dist_ac, dist_bc};
-                std::sort(sides, sides + 3);
-                t.a = sides[0];
-                t.b = sides[1];
-                t.c = sides[2];
-
-                triangles.push_back(t);
+    return catalog_to_triangles(catalog, 0);
+}
+
+std::vector<Triangle> catalog_to_triangles(const std::vector<Star>& catalog, int num_threads) {
+    const int n = catalog.size();
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // only stars within MAX_FOV_RAD of the anchor can share a triangle with it
+    const SkyIndex sky = build_sky_index(catalog, MAX_FOV_RAD);
+
+    const double cos_fov = std::cos(MAX_FOV_RAD);
+
+    // each worker takes anchor stars i and emits the triangles (i, j, k) with i < j < k
+    std::vector<std::vector<Triangle>> partial(num_threads);
+    std::atomic<int> next_star(0);
+
+    auto worker = [&](int t) {
+        std::vector<Triangle>& out = partial[t];
+        std::vector<int> close;
+        std::vector<uint32_t> cone;
+        std::vector<double> close_dot;
+
+        for (int i = next_star++; i < n; i = next_star++) {
+            const Star& si = catalog[i];
+
+            close.clear();
+            cone_query(sky, si, MAX_FOV_RAD, cone);
+            for (uint32_t j : cone) {
+                if (static_cast<int>(j) > i) {
+                    close.push_back(j);
+                }
+            }
+            cone.clear();
+            std::sort(close.begin(), close.end());
+
+            close_dot.resize(close.size());
+            for (size_t m = 0; m < close.size(); ++m) {
+                const Star& sj = catalog[close[m]];
+                close_dot[m] = std::clamp(si.x*sj.x + si.y*sj.y + si.z*sj.z, -1.0, 1.0);
+            }
+
+            for (size_t m1 = 0; m1 < close.size(); ++m1) {
+                const Star& sj = catalog[close[m1]];
+                double dist_ab = std::acos(close_dot[m1]);
+
+                for (size_t m2 = m1 + 1; m2 < close.size(); ++m2) {
+                    const Star& sk = catalog[close[m2]];
+                    double dot_bc = sj.x*sk.x + sj.y*sk.y + sj.z*sk.z;
+                    if (dot_bc < cos_fov) continue;
+
+                    Triangle tri;
+                    tri.star1 = si.id;
+                    tri.star2 = sj.id;
+                    tri.star3 = sk.id;
+
+                    double sides[3] = {dist_ab, std::acos(close_dot[m2]), std::acos(std::clamp(dot_bc, -1.0, 1.0))};
+                    std::sort(sides, sides + 3);
+                    tri.a = sides[0];
+                    tri.b = sides[1];
+                    tri.c = sides[2];
+
+                    out.push_back(tri);
+                }
             }
         }
+
+        std::sort(out.begin(), out.end(), triangle_less);
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; ++t) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (std::thread& th : threads) {
+        th.join();
     }
 
-    std::sort(triangles.begin(), triangles.end(), [](const Triangle& t1, const Triangle& t2) {
-        return t1.a < t2.a;
-    });
+    // concatenate the sorted runs, then merge them pairwise in parallel
+    std::vector<size_t> run_start = {0};
+    for (const auto& p : partial) {
+        run_start.push_back(run_start.back() + p.size());
+    }
+    std::vector<Triangle> triangles(run_start.back());
+    for (int t = 0; t < num_threads; ++t) {
+        std::copy(partial[t].begin(), partial[t].end(), triangles.begin() + run_start[t]);
+        std::vector<Triangle>().swap(partial[t]);
+    }
+
+    std::vector<Triangle> buffer(triangles.size());
+    while (run_start.size() > 2) {
+        std::vector<size_t> merged_start = {0};
+        std::vector<std::thread> mergers;
+        for (size_t r = 0; r + 1 < run_start.size(); r += 2) {
+            size_t begin = run_start[r];
+            size_t mid = run_start[r + 1];
+            size_t end = (r + 2 < run_start.size()) ? run_start[r + 2] : mid;
+            mergers.emplace_back([&, begin, mid, end]() {
+                std::merge(triangles.begin() + begin, triangles.begin() + mid,
+                           triangles.begin() + mid, triangles.begin() + end,
+                           buffer.begin() + begin, triangle_less);
+            });
+            merged_start.push_back(end);
+        }
+        for (std::thread& th : mergers) {
+            th.join();
+        }
+        triangles.swap(buffer);
+        run_start.swap(merged_start);
+    }
 
     return triangles;
 }
 
+// Sorted side lengths (a <= b <= c) of the triangle spanned by three unit vectors
+static void observed_sides(const Star& s1, const Star& s2, const Star& s3, double sides[3]) {
+    sides[0] = std::acos(std::clamp(s1.x*s2.x + s1.y*s2.y + s1.z*s2.z, -1.0, 1.0));
+    sides[1] = std::acos(std::clamp(s2.x*s3.x + s2.y*s3.y + s2.z*s3.z, -1.0, 1.0));
+    sides[2] = std::acos(std::clamp(s3.x*s1.x + s3.y*s1.y + s3.z*s1.z, -1.0, 1.0));
+    std::sort(sides, sides + 3);
+}
+
 Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std::vector<Triangle>& triangles) {
-    double dot_12 = std::clamp(s1.x*s2.x + s1.y*s2.y + s1.z*s2.z, -1.0, 1.0);
-    double dot_23 = std::clamp(s2.x*s3.x + s2.y*s3.y + s2.z*s3.z, -1.0, 1.0);
-    double dot_31 = std::clamp(s3.x*s1.x + s3.y*s1.y + s3.z*s1.z, -1.0, 1.0);
-
-    std::vector<double> sides = {
-        std::acos(dot_12),
-        std::acos(dot_23),
-        std::acos(dot_31)
-    };
-    
-    std::sort(sides.begin(), sides.end());
-    
+    return find_triangle(s1, s2, s3, triangles.data(), triangles.size());
+}
+
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const Triangle* triangles, size_t count) {
+    double sides[3];
+    observed_sides(s1, s2, s3, sides);
+
     double obs_a = sides[0];
     double obs_b = sides[1];
     double obs_c = sides[2];
@@ -69,7 +161,8 @@ Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std
     Triangle target; 
     target.a = obs_a - TOLERANCE_RAD;
 
-    auto it = std::lower_bound(triangles.begin(), triangles.end(), target, 
+    const Triangle* end = triangles + count;
+    const Triangle* it = std::lower_bound(triangles, end, target, 
         [](const Triangle& t1, const Triangle& t2) {
             return t1.a < t2.a;
         }
@@ -77,12 +170,15 @@ Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std
 
     Triangle best = {-1, -1, -1, 0, 0, 0};
     double best_error = std::numeric_limits<double>::infinity();
+    const Triangle* band_start = it;
+    uint64_t matches = 0;
 
-    for (; it != triangles.end(); ++it) {
+    for (; it != end; ++it) {
         if (it->a > obs_a + TOLERANCE_RAD) break;
 
         if (std::abs(it->b - obs_b) < TOLERANCE_RAD && 
             std::abs(it->c - obs_c) < TOLERANCE_RAD) {
+            ++matches;
 
             double error = std::abs(it->a - obs_a) + std::abs(it->b - obs_b) + std::abs(it->c - obs_c);
             if (error < best_error) {
@@ -92,5 +188,354 @@ Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std
         }
     }
 
+    INSTRUMENT_COUNT(COUNTER_TRIANGLE_LOOKUPS, 1);
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_CANDIDATES, it - band_start);
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_MATCHES, matches);
+    return best;
+}
+
+TriangleIndex build_triangle_index(const std::vector<Triangle>& triangles) {
+    return build_triangle_index(triangles.data(), triangles.size());
+}
+
+TriangleIndex build_triangle_index(const Triangle* triangles, size_t count) {
+    TriangleIndex index;
+    index.cell_size = TOLERANCE_RAD / 4;
+
+    double max_side = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        max_side = std::max(max_side, triangles[i].c);
+    }
+    index.dims = static_cast<int>(max_side / index.cell_size) + 1;
+
+    const size_t dims = index.dims;
+    auto cell_of = [&](const Triangle& t) {
+        size_t ia = std::min<size_t>(dims - 1, static_cast<size_t>(std::max(0.0, t.a) / index.cell_size));
+        size_t ib = std::min<size_t>(dims - 1, static_cast<size_t>(std::max(0.0, t.b) / index.cell_size));
+        size_t ic = std::min<size_t>(dims - 1, static_cast<size_t>(std::max(0.0, t.c) / index.cell_size));
+        return (ia * dims + ib) * dims + ic;
+    };
+
+    // counting sort of table positions by cell, so each cell lists them in table order
+    index.cell_start.assign(dims * dims * dims + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        index.cell_start[cell_of(triangles[i]) + 1]++;
+    }
+    for (size_t c = 0; c + 1 < index.cell_start.size(); ++c) {
+        index.cell_start[c + 1] += index.cell_start[c];
+    }
+
+    index.entries.resize(count);
+    std::vector<uint32_t> fill(index.cell_start.begin(), index.cell_start.end() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        index.entries[fill[cell_of(triangles[i])]++] = static_cast<uint32_t>(i);
+    }
+
+    return index;
+}
+
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std::vector<Triangle>& triangles, const TriangleIndex& index) {
+    return find_triangle(s1, s2, s3, triangles.data(), index);
+}
+
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const Triangle* triangles, const TriangleIndex& index) {
+    Triangle best = {-1, -1, -1, 0, 0, 0};
+    INSTRUMENT_COUNT(COUNTER_TRIANGLE_LOOKUPS, 1);
+    if (index.dims == 0) {
+        return best;
+    }
+
+    double obs[3];
+    observed_sides(s1, s2, s3, obs);
+
+    // range of cells overlapping the tolerance box on each axis
+    int lo[3], hi[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        if (obs[axis] + TOLERANCE_RAD < 0 || obs[axis] - TOLERANCE_RAD >= index.dims * index.cell_size) {
+            return best;
+        }
+        lo[axis] = std::max(0, static_cast<int>(std::floor((obs[axis] - TOLERANCE_RAD) / index.cell_size)));
+        hi[axis] = std::min(index.dims - 1, static_cast<int>(std::floor((obs[axis] + TOLERANCE_RAD) / index.cell_size)));
+    }
+
+    // same acceptance test and error as the linear scan; ties go to the earlier table entry
+    double best_error = std::numeric_limits<double>::infinity();
+    uint32_t best_pos = 0;
+    uint64_t candidates = 0, matches = 0;
+
+    const size_t dims = index.dims;
+    for (int ia = lo[0]; ia <= hi[0]; ++ia) {
+        for (int ib = std::max(lo[1], ia); ib <= hi[1]; ++ib) {
+            for (int ic = std::max(lo[2], ib); ic <= hi[2]; ++ic) {
+                size_t cell = (ia * dims + ib) * dims + ic;
+                candidates += index.cell_start[cell + 1] - index.cell_start[cell];
+                for (uint32_t e = index.cell_start[cell]; e < index.cell_start[cell + 1]; ++e) {
+                    uint32_t pos = index.entries[e];
+                    const Triangle& t = triangles[pos];
+
+                    if (std::abs(t.a - obs[0]) <= TOLERANCE_RAD &&
+                        std::abs(t.b - obs[1]) < TOLERANCE_RAD &&
+                        std::abs(t.c - obs[2]) < TOLERANCE_RAD) {
+                        ++matches;
+
+                        double error = std::abs(t.a - obs[0]) + std::abs(t.b - obs[1]) + std::abs(t.c - obs[2]);
+                        if (error < best_error || (error == best_error && pos < best_pos)) {
+                            best_error = error;
+                            best_pos = pos;
+                            best = t;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_CANDIDATES, candidates);
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_MATCHES, matches);
     return best;
-}
\ No newline at end of file
+}
+
+TriangleTable triangles_to_table(const std::vector<Triangle>& triangles, const std::vector<Star>& catalog) {
+    TriangleTable table;
+
+    if (catalog.size() > std::numeric_limits<uint16_t>::max() + size_t(1)) {
+        std::cerr << "Error: catalog has " << catalog.size() << " stars, too many for 16-bit triangle indices." << std::endl;
+        return table;
+    }
+
+    std::unordered_map<int, uint16_t> id_to_index;
+    for (size_t i = 0; i < catalog.size(); ++i) {
+        id_to_index[catalog[i].id] = static_cast<uint16_t>(i);
+    }
+
+    const size_t n = triangles.size();
+    table.a.resize(n);
+    table.b.resize(n);
+    table.c.resize(n);
+    table.star1.resize(n);
+    table.star2.resize(n);
+    table.star3.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const Triangle& t = triangles[i];
+        auto it1 = id_to_index.find(t.star1);
+        auto it2 = id_to_index.find(t.star2);
+        auto it3 = id_to_index.find(t.star3);
+        if (it1 == id_to_index.end() || it2 == id_to_index.end() || it3 == id_to_index.end()) {
+            std::cerr << "Error: triangle references a star that is not in the catalog." << std::endl;
+            return TriangleTable();
+        }
+
+        table.a[i] = static_cast<float>(t.a);
+        table.b[i] = static_cast<float>(t.b);
+        table.c[i] = static_cast<float>(t.c);
+        table.star1[i] = it1->second;
+        table.star2[i] = it2->second;
+        table.star3[i] = it3->second;
+    }
+
+    return table;
+}
+
+// --- Band scan kernels for the compact table ---
+
+static size_t scan_scalar(const float* b, const float* c, size_t len, float obs_b, float obs_c, float tol, uint16_t* hits) {
+    // branch-free compares, then compact; the SIMD versions are scan_avx2 and scan_avx512
+    uint8_t pass[SCAN_CHUNK];
+    for (size_t k = 0; k < len; ++k) {
+        pass[k] = (std::abs(b[k] - obs_b) < tol) & (std::abs(c[k] - obs_c) < tol);
+    }
+
+    size_t count = 0;
+    for (size_t k = 0; k < len; ++k) {
+        hits[count] = static_cast<uint16_t>(k);
+        count += pass[k];
+    }
+    return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const float* b, const float* c, size_t len, float obs_b, float obs_c, float tol, uint16_t* hits) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 vb = _mm256_set1_ps(obs_b);
+    const __m256 vc = _mm256_set1_ps(obs_c);
+    const __m256 vt = _mm256_set1_ps(tol);
+
+    size_t count = 0;
+    size_t k = 0;
+    for (; k + 8 <= len; k += 8) {
+        __m256 db = _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_loadu_ps(b + k), vb));
+        __m256 dc = _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_loadu_ps(c + k), vc));
+        __m256 ok = _mm256_and_ps(_mm256_cmp_ps(db, vt, _CMP_LT_OQ), _mm256_cmp_ps(dc, vt, _CMP_LT_OQ));
+
+        unsigned mask = _mm256_movemask_ps(ok);
+        while (mask) {
+            hits[count++] = static_cast<uint16_t>(k + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; k < len; ++k) {
+        if ((std::abs(b[k] - obs_b) < tol) & (std::abs(c[k] - obs_c) < tol)) {
+            hits[count++] = static_cast<uint16_t>(k);
+        }
+    }
+    return count;
+}
+
+__attribute__((target("avx512f")))
+static size_t scan_avx512(const float* b, const float* c, size_t len, float obs_b, float obs_c, float tol, uint16_t* hits) {
+    const __m512 vb = _mm512_set1_ps(obs_b);
+    const __m512 vc = _mm512_set1_ps(obs_c);
+    const __m512 vt = _mm512_set1_ps(tol);
+
+    size_t count = 0;
+    size_t k = 0;
+    for (; k + 16 <= len; k += 16) {
+        __m512 db = _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(b + k), vb));
+        __m512 dc = _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(c + k), vc));
+        __mmask16 ok = _mm512_cmp_ps_mask(db, vt, _CMP_LT_OQ);
+        ok = _mm512_mask_cmp_ps_mask(ok, dc, vt, _CMP_LT_OQ);
+
+        unsigned mask = ok;
+        while (mask) {
+            hits[count++] = static_cast<uint16_t>(k + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; k < len; ++k) {
+        if ((std::abs(b[k] - obs_b) < tol) & (std::abs(c[k] - obs_c) < tol)) {
+            hits[count++] = static_cast<uint16_t>(k);
+        }
+    }
+    return count;
+}
+
+#endif
+
+// Picked once, from what the CPU we are running on supports
+static ScanKernel select_scan_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return scan_avx512;
+    if (__builtin_cpu_supports("avx2")) return scan_avx2;
+#endif
+    return scan_scalar;
+}
+
+static const ScanKernel scan_band = select_scan_kernel();
+
+std::vector<std::pair<const char*, ScanKernel>> scan_kernels() {
+    std::vector<std::pair<const char*, ScanKernel>> kernels = {{"scalar", scan_scalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) kernels.push_back({"avx2", scan_avx2});
+    if (__builtin_cpu_supports("avx512f")) kernels.push_back({"avx512", scan_avx512});
+#endif
+    return kernels;
+}
+
+// Best entry of the compact table for sorted observed sides, or -1.
+// The a-band search starts at `from`, which is moved to the start of the band.
+static long match_in_table(const double obs[3], const TriangleTable& table, size_t& from) {
+    const float tol = static_cast<float>(TOLERANCE_RAD);
+    const float obs_b = static_cast<float>(obs[1]);
+    const float obs_c = static_cast<float>(obs[2]);
+
+    size_t begin = std::lower_bound(table.a.begin() + from, table.a.end(), static_cast<float>(obs[0] - TOLERANCE_RAD)) - table.a.begin();
+    from = begin;
+    size_t end = std::upper_bound(table.a.begin() + begin, table.a.end(), static_cast<float>(obs[0] + TOLERANCE_RAD)) - table.a.begin();
+
+    double best_error = std::numeric_limits<double>::infinity();
+    long best_pos = -1;
+    uint16_t hits[SCAN_CHUNK];
+
+    uint64_t matches = 0;
+    for (size_t chunk = begin; chunk < end; chunk += SCAN_CHUNK) {
+        size_t len = std::min(SCAN_CHUNK, end - chunk);
+        size_t count = scan_band(table.b.data() + chunk, table.c.data() + chunk, len, obs_b, obs_c, tol, hits);
+        matches += count;
+
+        for (size_t h = 0; h < count; ++h) {
+            size_t pos = chunk + hits[h];
+            double error = std::abs(table.a[pos] - obs[0]) + std::abs(table.b[pos] - obs[1]) + std::abs(table.c[pos] - obs[2]);
+            if (error < best_error) {
+                best_error = error;
+                best_pos = pos;
+            }
+        }
+    }
+
+    INSTRUMENT_COUNT(COUNTER_TRIANGLE_LOOKUPS, 1);
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_CANDIDATES, end - begin);
+    INSTRUMENT_COUNT(COUNTER_LOOKUP_MATCHES, matches);
+    return best_pos;
+}
+
+static Triangle table_entry(const TriangleTable& table, const std::vector<Star>& catalog, long pos) {
+    if (pos < 0) {
+        return {-1, -1, -1, 0, 0, 0};
+    }
+    return {
+        catalog[table.star1[pos]].id,
+        catalog[table.star2[pos]].id,
+        catalog[table.star3[pos]].id,
+        table.a[pos],
+        table.b[pos],
+        table.c[pos]
+    };
+}
+
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const TriangleTable& table, const std::vector<Star>& catalog) {
+    double obs[3];
+    observed_sides(s1, s2, s3, obs);
+    size_t from = 0;
+    return table_entry(table, catalog, match_in_table(obs, table, from));
+}
+
+std::vector<Triangle> find_triangles(const std::vector<StarTriple>& queries, const TriangleTable& table, const std::vector<Star>& catalog) {
+    std::vector<Triangle> matches(queries.size());
+    find_triangles(queries.data(), queries.size(), table, catalog, matches.data());
+    return matches;
+}
+
+void find_triangles(const StarTriple* queries, size_t count, const TriangleTable& table, const std::vector<Star>& catalog, Triangle* matches) {
+    // pairwise dot products in one flat pass, then sides sorted with min/max
+    std::vector<double> sides(count * 3);
+    for (size_t q = 0; q < count; ++q) {
+        const Star& s1 = queries[q].s1;
+        const Star& s2 = queries[q].s2;
+        const Star& s3 = queries[q].s3;
+        sides[q * 3 + 0] = s1.x*s2.x + s1.y*s2.y + s1.z*s2.z;
+        sides[q * 3 + 1] = s2.x*s3.x + s2.y*s3.y + s2.z*s3.z;
+        sides[q * 3 + 2] = s3.x*s1.x + s3.y*s1.y + s3.z*s1.z;
+    }
+    for (size_t i = 0; i < count * 3; ++i) {
+        sides[i] = std::acos(std::clamp(sides[i], -1.0, 1.0));
+    }
+    for (size_t q = 0; q < count; ++q) {
+        double* s = &sides[q * 3];
+        double lo = std::min(s[0], s[1]);
+        double hi = std::max(s[0], s[1]);
+        double mid = std::max(lo, std::min(hi, s[2]));
+        s[0] = std::min(lo, s[2]);
+        s[2] = std::max(hi, s[2]);
+        s[1] = mid;
+    }
+
+    // visit queries in order of side a so the table is walked front to back once
+    std::vector<uint32_t> order(count);
+    for (size_t q = 0; q < count; ++q) {
+        order[q] = static_cast<uint32_t>(q);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t q1, uint32_t q2) {
+        return sides[q1 * 3] < sides[q2 * 3];
+    });
+
+    size_t from = 0;
+    for (uint32_t q : order) {
+        const double* obs = &sides[q * 3];
+        matches[q] = table_entry(table, catalog, match_in_table(obs, table, from));
+    }
+}
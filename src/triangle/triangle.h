@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cmath>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 
 #include "../catalog/catalog.h"
 
@@ -12,6 +16,66 @@ struct Triangle {
     double a, b, c; // a <= b <= c
 };
 
+// Compact structure-of-arrays copy of the a-sorted table: float sides in
+// separate arrays and 16-bit positions into the catalog instead of IDs
+// (18 bytes per triangle instead of 40).
+struct TriangleTable {
+    std::vector<float> a, b, c;
+    std::vector<uint16_t> star1, star2, star3;
+
+    size_t size() const { return a.size(); }
+};
+
+struct StarTriple {
+    Star s1, s2, s3;
+};
+
+// Uniform grid over (a, b, c) with cells a quarter of TOLERANCE_RAD wide.
+// Each cell lists the positions of its triangles in the a-sorted table, so a
+// lookup only visits the cells overlapping the tolerance box.
+struct TriangleIndex {
+    double cell_size = 0.0;
+    int dims = 0; // cells per axis
+
+    std::vector<uint32_t> cell_start; // dims^3 + 1 offsets into entries
+    std::vector<uint32_t> entries;    // table positions grouped by cell
+};
+
 std::vector<Triangle> catalog_to_triangles(const std::vector<Star>& catalog);
 
-Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std::vector<Triangle>& triangles);
\ No newline at end of file
+// Bins the catalog into cube-map cells and only pairs stars from cells within
+// MAX_FOV_RAD of each other. num_threads <= 0 uses every hardware thread.
+std::vector<Triangle> catalog_to_triangles(const std::vector<Star>& catalog, int num_threads);
+
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std::vector<Triangle>& triangles);
+
+// Same search over a table that is not owned by a vector (e.g. a mapped database)
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const Triangle* triangles, size_t count);
+
+TriangleIndex build_triangle_index(const std::vector<Triangle>& triangles);
+TriangleIndex build_triangle_index(const Triangle* triangles, size_t count);
+
+// Indexed lookup; returns the same match as the linear scan over the table
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const std::vector<Triangle>& triangles, const TriangleIndex& index);
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const Triangle* triangles, const TriangleIndex& index);
+
+// Empty table if the catalog has more than 65536 stars or is missing a referenced ID
+TriangleTable triangles_to_table(const std::vector<Triangle>& triangles, const std::vector<Star>& catalog);
+
+// Search over the compact table; star IDs of the match are read back from the catalog
+Triangle find_triangle(const Star& s1, const Star& s2, const Star& s3, const TriangleTable& table, const std::vector<Star>& catalog);
+
+// Batched lookup against the compact table: one match per query, in query order.
+// Queries are visited in order of side a and the b/c tests use AVX2/AVX-512
+// kernels when the CPU supports them.
+std::vector<Triangle> find_triangles(const std::vector<StarTriple>& queries, const TriangleTable& table, const std::vector<Star>& catalog);
+void find_triangles(const StarTriple* queries, size_t count, const TriangleTable& table, const std::vector<Star>& catalog, Triangle* matches);
+
+// Band scan kernel used by the compact table searches: tests entries
+// [0, len) of one chunk (len <= SCAN_CHUNK) against the b/c tolerance and
+// writes the offsets that pass, in ascending order. Returns their count.
+static const size_t SCAN_CHUNK = 256;
+typedef size_t (*ScanKernel)(const float* b, const float* c, size_t len, float obs_b, float obs_c, float tol, uint16_t* hits);
+
+// Every scan kernel the CPU supports, by name, scalar first
+std::vector<std::pair<const char*, ScanKernel>> scan_kernels();